@@ -31,8 +31,8 @@
 
 #include "detector/detector.hpp"
 
+#include "master/allocator_factory.hpp"
 #include "master/master.hpp"
-#include "master/simple_allocator.hpp"
 
 #include "slave/process_based_isolation_module.hpp"
 #include "slave/slave.hpp"
@@ -40,8 +40,8 @@
 using namespace mesos::internal;
 
 using mesos::internal::master::Allocator;
+using mesos::internal::master::AllocatorFactory;
 using mesos::internal::master::Master;
-using mesos::internal::master::SimpleAllocator;
 
 using mesos::internal::slave::Slave;
 using mesos::internal::slave::IsolationModule;
@@ -104,8 +104,12 @@ PID<Master> launch(const Configuration& conf, Allocator* _allocator)
   }
 
   if (_allocator == NULL) {
-    // Create default allocator, save it for deleting later.
-    _allocator = allocator = new SimpleAllocator();
+    // Create the configured allocator, save it for deleting later.
+    string name = conf.get("allocator", "simple");
+    _allocator = allocator = AllocatorFactory::instantiate(name, NULL);
+    if (allocator == NULL) {
+      fatal("unrecognized allocator: %s", name.c_str());
+    }
   } else {
     // TODO(benh): Figure out the behavior of allocator pointer and remove the
     // else block.
@@ -20,11 +20,21 @@
 #define __ALLOCATOR_HPP__
 
 #include "common/hashmap.hpp"
+#include "common/option.hpp"
 #include "common/resources.hpp"
 
+#include "configurator/configuration.hpp"
+
 #include "master/master.hpp"
 
 
+namespace JSON {
+
+struct Object;
+
+} // namespace JSON {
+
+
 namespace mesos {
 namespace internal {
 namespace master {
@@ -39,12 +49,18 @@ class Allocator {
 public:
   virtual ~Allocator() {}
 
-  virtual void initialize(Master* _master) {}
+  virtual void initialize(Master* _master, const Configuration& conf) {}
 
   virtual void frameworkAdded(Framework* framework) {}
 
   virtual void frameworkRemoved(Framework* framework) {}
 
+  // Whenever a framework stops (e.g., disconnects) or starts again
+  // (e.g., fails over) getting offers the master invokes these.
+  virtual void frameworkActivated(Framework* framework) {}
+
+  virtual void frameworkDeactivated(Framework* framework) {}
+
   virtual void slaveAdded(Slave* slave) {}
 
   virtual void slaveRemoved(Slave* slave) {}
@@ -54,11 +70,15 @@ public:
       const std::vector<ResourceRequest>& requests) {}
 
   // Whenever resources offered to a framework go unused (e.g.,
-  // refused) the master invokes this callback.
+  // refused) the master invokes this callback. If the framework
+  // refused the offer outright, 'filter' is the time until which it
+  // doesn't want these resources on the slave again (0 meaning
+  // forever), see Filters in mesos.proto.
   virtual void resourcesUnused(
       const FrameworkID& frameworkId,
       const SlaveID& slaveId,
-      const Resources& resources) {}
+      const Resources& resources,
+      const Option<double>& filter) {}
 
   // Whenever resources are "recovered" in the cluster (e.g., a task
   // finishes, an offer is removed because a framework has failed or
@@ -69,10 +89,15 @@ public:
       const Resources& resources) {}
 
   // Whenever a framework that has filtered resources want's to revive
-  // offers for those resources the master invokes this callback.
+  // offers for those resources the master invokes this callback (all
+  // of the framework's filters should be removed).
   virtual void offersRevived(Framework* framework) {}
 
   virtual void timerTick() {}
+
+  // Adds any statistics the allocator keeps (e.g., about its
+  // allocation passes) to those reported by the master.
+  virtual void statistics(JSON::Object* object) const {}
 };
 
 } // namespace master {
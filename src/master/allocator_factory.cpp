@@ -17,6 +17,7 @@
  */
 
 #include "allocator_factory.hpp"
+#include "drf_allocator.hpp"
 #include "simple_allocator.hpp"
 
 using namespace mesos::internal::master;
@@ -24,4 +25,5 @@ using namespace mesos::internal::master;
 DEFINE_FACTORY(Allocator, Master *)
 {
   registerClass<SimpleAllocator>("simple");
+  registerClass<DRFAllocator>("drf");
 }
@@ -53,6 +53,10 @@ const int MAX_SLAVE_TIMEOUTS = 5;
 // Time to wait for a framework to failover.
 const double FRAMEWORK_FAILOVER_TIMEOUT = 1.0;
 
+// Number of most recent allocation passes whose durations are kept
+// for computing percentiles (drf allocator only).
+const int MAX_ALLOCATION_PASS_TIMES = 1000;
+
 // Maximum number of completed frameworks to store in the cache.
 // TODO(thomasm): Make configurable.
 const int MAX_COMPLETED_FRAMEWORKS = 100;
@@ -0,0 +1,630 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <glog/logging.h>
+
+#include <algorithm>
+
+#include <process/dispatch.hpp>
+#include <process/timer.hpp>
+
+#include "common/json.hpp"
+#include "common/lock.hpp"
+#include "common/timer.hpp"
+#include "common/utils.hpp"
+
+#include "master/drf_allocator.hpp"
+
+using namespace process;
+
+using std::max;
+using std::min;
+using std::vector;
+
+
+namespace mesos {
+namespace internal {
+namespace master {
+
+// Returns the given percentile of sorted values.
+static double percentile(const vector<double>& values, double p)
+{
+  if (values.empty()) {
+    return 0;
+  }
+
+  size_t index = (size_t) (p * (values.size() - 1) + 0.5);
+  return values[min(index, values.size() - 1)];
+}
+
+
+DRFAllocatorProcess::DRFAllocatorProcess(
+    const PID<Master>& _master,
+    const Configuration& conf)
+  : master(_master),
+    interval(conf.get<double>("allocation_interval", 1.0))
+{
+  int size = conf.get<int>("allocation_batch_size", 16);
+  batchSize = size > 1 ? size : 1;
+
+  stats.passes = 0;
+  stats.slavesConsidered = 0;
+  stats.lastSlavesConsidered = 0;
+  stats.totalTime = 0;
+  stats.lastTime = 0;
+  stats.maxTime = 0;
+
+  pthread_mutex_init(&mutex, NULL);
+}
+
+
+DRFAllocatorProcess::~DRFAllocatorProcess()
+{
+  pthread_mutex_destroy(&mutex);
+}
+
+
+void DRFAllocatorProcess::initialize()
+{
+  delay(interval, self(), &DRFAllocatorProcess::timerTick);
+}
+
+
+void DRFAllocatorProcess::frameworkAdded(
+    const FrameworkID& frameworkId,
+    const hashmap<SlaveID, Resources>& used)
+{
+  frameworks[frameworkId] = true;
+
+  // A framework that re-registers (e.g., with a new master) might
+  // already have tasks and executors running. Those on slaves that
+  // got added before it have already been accounted for.
+  foreachkey (const SlaveID& slaveId, used) {
+    if (totals.contains(slaveId) &&
+        !(allocations.contains(frameworkId) &&
+          allocations[frameworkId].contains(slaveId))) {
+      allocations[frameworkId][slaveId] = used.find(slaveId)->second;
+      available[slaveId] -= used.find(slaveId)->second;
+    }
+  }
+
+  sorter.add(frameworkId);
+
+  if (allocations.contains(frameworkId)) {
+    foreachvalue (const Resources& resources, allocations[frameworkId]) {
+      sorter.allocated(frameworkId, resources);
+    }
+  }
+
+  LOG(INFO) << "Added framework " << frameworkId;
+
+  dirtyFrameworks.insert(frameworkId);
+  batch();
+}
+
+
+void DRFAllocatorProcess::frameworkRemoved(const FrameworkID& frameworkId)
+{
+  // The master doesn't recover the resources of the framework's
+  // executors, so take back whatever the framework still has.
+  if (allocations.contains(frameworkId)) {
+    foreachkey (const SlaveID& slaveId, allocations[frameworkId]) {
+      if (totals.contains(slaveId)) {
+        available[slaveId] += allocations[frameworkId][slaveId];
+        dirtySlaves.insert(slaveId);
+      }
+    }
+  }
+
+  frameworks.erase(frameworkId);
+  sorter.remove(frameworkId);
+  allocations.erase(frameworkId);
+  filters.remove(frameworkId);
+  refusers.remove(frameworkId);
+  dirtyFrameworks.erase(frameworkId);
+
+  LOG(INFO) << "Removed framework " << frameworkId;
+
+  batch();
+}
+
+
+void DRFAllocatorProcess::frameworkActivated(const FrameworkID& frameworkId)
+{
+  if (frameworks.contains(frameworkId)) {
+    frameworks[frameworkId] = true;
+    dirtyFrameworks.insert(frameworkId);
+    batch();
+  }
+}
+
+
+void DRFAllocatorProcess::frameworkDeactivated(const FrameworkID& frameworkId)
+{
+  if (frameworks.contains(frameworkId)) {
+    frameworks[frameworkId] = false;
+  }
+}
+
+
+void DRFAllocatorProcess::slaveAdded(
+    const SlaveID& slaveId,
+    const Resources& resources,
+    const hashmap<FrameworkID, Resources>& used)
+{
+  LOG(INFO) << "Added slave " << slaveId << " with " << resources;
+
+  totals[slaveId] = resources;
+  available[slaveId] = resources;
+  sorter.add(resources);
+
+  // A slave that re-registers might already be running tasks and
+  // executors (possibly of frameworks that haven't been added yet).
+  foreachkey (const FrameworkID& frameworkId, used) {
+    allocated(frameworkId, slaveId, used.find(frameworkId)->second);
+  }
+
+  dirtySlaves.insert(slaveId);
+  batch();
+}
+
+
+void DRFAllocatorProcess::slaveRemoved(const SlaveID& slaveId)
+{
+  LOG(INFO) << "Removed slave " << slaveId;
+
+  sorter.remove(totals[slaveId]);
+
+  // Take back whatever the frameworks still had on the slave (the
+  // master doesn't recover outstanding offers or executors for a
+  // slave that is gone).
+  foreachkey (const FrameworkID& frameworkId, allocations) {
+    if (allocations[frameworkId].contains(slaveId)) {
+      if (sorter.contains(frameworkId)) {
+        sorter.unallocated(frameworkId, allocations[frameworkId][slaveId]);
+      }
+      allocations[frameworkId].erase(slaveId);
+    }
+  }
+
+  totals.erase(slaveId);
+  available.erase(slaveId);
+  filters.remove(slaveId);
+  refusers.remove(slaveId);
+  dirtySlaves.erase(slaveId);
+  unofferedSlaves.erase(slaveId);
+}
+
+
+void DRFAllocatorProcess::resourcesUnused(
+    const FrameworkID& frameworkId,
+    const SlaveID& slaveId,
+    const Resources& resources,
+    const Option<double>& filter)
+{
+  unallocated(frameworkId, slaveId, resources);
+
+  if (filter.isSome() && frameworks.contains(frameworkId) &&
+      totals.contains(slaveId)) {
+    filters.add(frameworkId, slaveId, resources, filter.get());
+  }
+
+  if (resources.allocatable().size() > 0) {
+    VLOG(1) << "Framework " << frameworkId
+            << " left " << resources.allocatable()
+            << " unused on slave " << slaveId;
+    refusers.add(slaveId, frameworkId);
+  }
+
+  if (totals.contains(slaveId)) {
+    dirtySlaves.insert(slaveId);
+  }
+
+  batch();
+}
+
+
+void DRFAllocatorProcess::resourcesRecovered(
+    const FrameworkID& frameworkId,
+    const SlaveID& slaveId,
+    const Resources& resources)
+{
+  unallocated(frameworkId, slaveId, resources);
+
+  if (resources.allocatable().size() > 0) {
+    VLOG(1) << "Recovered " << resources.allocatable()
+            << " on slave " << slaveId
+            << " from framework " << frameworkId;
+    refusers.remove(slaveId);
+  }
+
+  if (totals.contains(slaveId)) {
+    dirtySlaves.insert(slaveId);
+  }
+
+  batch();
+}
+
+
+void DRFAllocatorProcess::offersRevived(const FrameworkID& frameworkId)
+{
+  LOG(INFO) << "Filters removed for framework " << frameworkId;
+
+  filters.remove(frameworkId);
+
+  if (frameworks.contains(frameworkId)) {
+    dirtyFrameworks.insert(frameworkId);
+    batch();
+  }
+}
+
+
+JSON::Object DRFAllocatorProcess::statistics() const
+{
+  Lock lock(&mutex);
+
+  JSON::Object object;
+  object.values["allocation_passes"] = stats.passes;
+  object.values["allocation_slaves_considered"] = stats.slavesConsidered;
+  object.values["allocation_last_slaves_considered"] =
+    stats.lastSlavesConsidered;
+  object.values["allocation_total_secs"] = stats.totalTime;
+  object.values["allocation_last_secs"] = stats.lastTime;
+  object.values["allocation_max_secs"] = stats.maxTime;
+
+  vector<double> times = stats.times;
+  std::sort(times.begin(), times.end());
+
+  object.values["allocation_p50_secs"] = percentile(times, 0.5);
+  object.values["allocation_p90_secs"] = percentile(times, 0.9);
+  object.values["allocation_p99_secs"] = percentile(times, 0.99);
+  return object;
+}
+
+
+void DRFAllocatorProcess::timerTick()
+{
+  // Give the slaves that nobody could take another chance (e.g., a
+  // filter might have expired).
+  foreach (const SlaveID& slaveId, unofferedSlaves) {
+    dirtySlaves.insert(slaveId);
+  }
+
+  unofferedSlaves.clear();
+
+  allocate();
+
+  delay(interval, self(), &DRFAllocatorProcess::timerTick);
+}
+
+
+void DRFAllocatorProcess::batch()
+{
+  if (dirtySlaves.size() + dirtyFrameworks.size() >= batchSize) {
+    allocate();
+  }
+}
+
+
+void DRFAllocatorProcess::allocate()
+{
+  // Frameworks that were added or revived might take the slaves that
+  // nobody else could.
+  if (!dirtyFrameworks.empty()) {
+    foreach (const SlaveID& slaveId, unofferedSlaves) {
+      dirtySlaves.insert(slaveId);
+    }
+
+    unofferedSlaves.clear();
+  }
+
+  if (dirtySlaves.empty()) {
+    dirtyFrameworks.clear();
+    return;
+  }
+
+  // Count the frameworks that can get offers, used to determine if a
+  // slave has been refused by everyone.
+  size_t active = 0;
+  foreachvalue (bool isActive, frameworks) {
+    if (isActive) {
+      active++;
+    }
+  }
+
+  if (active == 0) {
+    VLOG(1) << "No frameworks to allocate resources!";
+    return; // Keep everything dirty until there are.
+  }
+
+  filters.expire(Clock::now());
+
+  Timer timer;
+  timer.start();
+
+  hashmap<FrameworkID, hashmap<SlaveID, Resources> > offerable;
+
+  const size_t considered = dirtySlaves.size();
+
+  foreach (const SlaveID& slaveId, utils::copy(dirtySlaves)) {
+    // Unless nobody can take the slave's resources (see below) the
+    // slave needs no further passes until its resources change.
+    dirtySlaves.erase(slaveId);
+    unofferedSlaves.erase(slaveId);
+
+    Resources resources = available[slaveId].allocatable();
+
+    // Like the SimpleAllocator, only offer slaves that have some cpu
+    // and memory left (see the TODO in SimpleAllocator).
+    Value::Scalar none;
+    Value::Scalar cpus = resources.get("cpus", none);
+    Value::Scalar mem = resources.get("mem", none);
+
+    if (cpus.value() < MIN_CPUS || mem.value() <= MIN_MEM) {
+      continue;
+    }
+
+    if (refusers.count(slaveId) == active) {
+      VLOG(1) << "Clearing refusers for slave " << slaveId
+              << " because EVERYONE has refused resources from it";
+      refusers.remove(slaveId);
+    }
+
+    // Offer the slave to the framework with the lowest dominant share
+    // that hasn't refused or filtered it. The framework's share then
+    // includes these resources, so the next slave might well go to a
+    // different framework.
+    bool offered = false;
+
+    DRFSorter::const_iterator iterator = sorter.begin();
+    for (; iterator != sorter.end(); ++iterator) {
+      // A copy, since allocating moves the framework within the sorter.
+      const FrameworkID frameworkId = iterator->frameworkId;
+
+      if (frameworks[frameworkId] &&
+          !refusers.contains(slaveId, frameworkId) &&
+          !filters.filtered(frameworkId, slaveId, resources)) {
+        VLOG(1) << "Offering " << resources
+                << " on slave " << slaveId
+                << " to framework " << frameworkId;
+        offerable[frameworkId][slaveId] = resources;
+        allocated(frameworkId, slaveId, resources);
+        offered = true;
+        break; // The iterator is no longer valid.
+      }
+    }
+
+    if (!offered) {
+      unofferedSlaves.insert(slaveId); // Try again on the next tick.
+    }
+  }
+
+  dirtyFrameworks.clear();
+
+  foreachkey (const FrameworkID& frameworkId, offerable) {
+    dispatch(master, &Master::offer, frameworkId, offerable[frameworkId]);
+  }
+
+  timer.stop();
+
+  double elapsed = timer.elapsed().secs();
+
+  Lock lock(&mutex);
+
+  if (stats.times.size() < (size_t) MAX_ALLOCATION_PASS_TIMES) {
+    stats.times.push_back(elapsed);
+  } else {
+    stats.times[stats.passes % MAX_ALLOCATION_PASS_TIMES] = elapsed;
+  }
+
+  stats.passes++;
+  stats.slavesConsidered += considered;
+  stats.lastSlavesConsidered = considered;
+  stats.totalTime += elapsed;
+  stats.lastTime = elapsed;
+  stats.maxTime = max(stats.maxTime, elapsed);
+
+  lock.unlock();
+
+  VLOG(1) << "Allocation pass over " << considered << " slaves took "
+          << elapsed << " seconds";
+}
+
+
+void DRFAllocatorProcess::allocated(
+    const FrameworkID& frameworkId,
+    const SlaveID& slaveId,
+    const Resources& resources)
+{
+  if (totals.contains(slaveId)) {
+    allocations[frameworkId][slaveId] += resources;
+    available[slaveId] -= resources;
+
+    if (sorter.contains(frameworkId)) {
+      sorter.allocated(frameworkId, resources);
+    }
+  }
+}
+
+
+void DRFAllocatorProcess::unallocated(
+    const FrameworkID& frameworkId,
+    const SlaveID& slaveId,
+    const Resources& resources)
+{
+  // Resources of removed frameworks and slaves have already been
+  // taken back (see 'frameworkRemoved' and 'slaveRemoved').
+  if (allocations.contains(frameworkId) &&
+      allocations[frameworkId].contains(slaveId)) {
+    allocations[frameworkId][slaveId] -= resources;
+    available[slaveId] += resources;
+
+    if (sorter.contains(frameworkId)) {
+      sorter.unallocated(frameworkId, resources);
+    }
+  }
+}
+
+
+DRFAllocator::~DRFAllocator()
+{
+  if (process != NULL) {
+    terminate(process);
+    wait(process);
+    delete process;
+  }
+}
+
+
+void DRFAllocator::initialize(Master* _master, const Configuration& conf)
+{
+  master = _master;
+  process = new DRFAllocatorProcess(master->self(), conf);
+  spawn(process);
+}
+
+
+void DRFAllocator::frameworkAdded(Framework* framework)
+{
+  CHECK(process != NULL);
+
+  hashmap<SlaveID, Resources> used;
+
+  foreachvalue (Task* task, framework->tasks) {
+    used[task->slave_id()] += task->resources();
+  }
+
+  foreachkey (const SlaveID& slaveId, framework->executors) {
+    foreachvalue (const ExecutorInfo& executorInfo,
+                  framework->executors[slaveId]) {
+      used[slaveId] += executorInfo.resources();
+    }
+  }
+
+  dispatch(process, &DRFAllocatorProcess::frameworkAdded,
+           framework->id, used);
+}
+
+
+void DRFAllocator::frameworkRemoved(Framework* framework)
+{
+  CHECK(process != NULL);
+  dispatch(process, &DRFAllocatorProcess::frameworkRemoved, framework->id);
+}
+
+
+void DRFAllocator::frameworkActivated(Framework* framework)
+{
+  CHECK(process != NULL);
+  dispatch(process, &DRFAllocatorProcess::frameworkActivated, framework->id);
+}
+
+
+void DRFAllocator::frameworkDeactivated(Framework* framework)
+{
+  CHECK(process != NULL);
+  dispatch(process, &DRFAllocatorProcess::frameworkDeactivated,
+           framework->id);
+}
+
+
+void DRFAllocator::slaveAdded(Slave* slave)
+{
+  CHECK(process != NULL);
+
+  hashmap<FrameworkID, Resources> used;
+
+  foreachvalue (Task* task, slave->tasks) {
+    used[task->framework_id()] += task->resources();
+  }
+
+  foreachkey (const FrameworkID& frameworkId, slave->executors) {
+    foreachvalue (const ExecutorInfo& executorInfo,
+                  slave->executors[frameworkId]) {
+      used[frameworkId] += executorInfo.resources();
+    }
+  }
+
+  dispatch(process, &DRFAllocatorProcess::slaveAdded,
+           slave->id, Resources(slave->info.resources()), used);
+}
+
+
+void DRFAllocator::slaveRemoved(Slave* slave)
+{
+  CHECK(process != NULL);
+  dispatch(process, &DRFAllocatorProcess::slaveRemoved, slave->id);
+}
+
+
+void DRFAllocator::resourcesRequested(
+    const FrameworkID& frameworkId,
+    const vector<ResourceRequest>& requests)
+{
+  LOG(INFO) << "Received resource request from framework " << frameworkId;
+}
+
+
+void DRFAllocator::resourcesUnused(
+    const FrameworkID& frameworkId,
+    const SlaveID& slaveId,
+    const Resources& resources,
+    const Option<double>& filter)
+{
+  CHECK(process != NULL);
+  dispatch(process, &DRFAllocatorProcess::resourcesUnused,
+           frameworkId, slaveId, resources, filter);
+}
+
+
+void DRFAllocator::resourcesRecovered(
+    const FrameworkID& frameworkId,
+    const SlaveID& slaveId,
+    const Resources& resources)
+{
+  CHECK(process != NULL);
+  dispatch(process, &DRFAllocatorProcess::resourcesRecovered,
+           frameworkId, slaveId, resources);
+}
+
+
+void DRFAllocator::offersRevived(Framework* framework)
+{
+  CHECK(process != NULL);
+  dispatch(process, &DRFAllocatorProcess::offersRevived, framework->id);
+}
+
+
+void DRFAllocator::statistics(JSON::Object* object) const
+{
+  CHECK(process != NULL);
+
+  // Read the statistics directly rather than dispatching (and
+  // waiting), the master shouldn't block on the allocator.
+  JSON::Object statistics = process->statistics();
+
+  foreachpair (const std::string& name,
+               const JSON::Value& value,
+               statistics.values) {
+    object->values[name] = value;
+  }
+}
+
+} // namespace master {
+} // namespace internal {
+} // namespace mesos {
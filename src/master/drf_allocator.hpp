@@ -0,0 +1,242 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __DRF_ALLOCATOR_HPP__
+#define __DRF_ALLOCATOR_HPP__
+
+#include <pthread.h>
+
+#include <vector>
+
+#include <process/process.hpp>
+
+#include "common/hashmap.hpp"
+#include "common/hashset.hpp"
+#include "common/option.hpp"
+
+#include "configurator/configuration.hpp"
+
+#include "master/allocator.hpp"
+#include "master/drf_sorter.hpp"
+#include "master/offer_filters.hpp"
+
+
+namespace mesos {
+namespace internal {
+namespace master {
+
+// Does the allocations for the DRFAllocator (see below) in its own
+// process, using its own copy of the resources of every slave and
+// framework. The master keeps that copy up to date by dispatching
+// every change to it, and the process dispatches the resulting
+// offers back to the master (see Master::offer).
+//
+// Unlike the SimpleAllocator, it doesn't sort the frameworks for
+// every allocation. Instead it keeps track of what it has allocated
+// to each framework (on each slave) and keeps the frameworks ordered
+// by their dominant share as those allocations change (see
+// DRFSorter). Each available slave gets offered to the framework with
+// the lowest share that isn't filtering it, after which that
+// framework moves to its new position in the order.
+//
+// Allocations are batched: changes only mark the slaves (and
+// frameworks) they affect as "dirty", and an allocation pass (over
+// just the dirty slaves) runs once 'allocation_batch_size' of them
+// have accumulated or every 'allocation_interval' seconds. Slaves
+// that a pass couldn't offer to anyone (e.g., because of filters)
+// don't count towards the batch, they get another chance on the next
+// interval (or in a pass after a framework got added or revived).
+class DRFAllocatorProcess : public process::Process<DRFAllocatorProcess>
+{
+public:
+  DRFAllocatorProcess(const process::PID<Master>& _master,
+                      const Configuration& conf);
+
+  virtual ~DRFAllocatorProcess();
+
+  // Adds a framework along with the resources its tasks and
+  // executors are already using on each slave.
+  void frameworkAdded(const FrameworkID& frameworkId,
+                      const hashmap<SlaveID, Resources>& used);
+
+  void frameworkRemoved(const FrameworkID& frameworkId);
+
+  void frameworkActivated(const FrameworkID& frameworkId);
+
+  void frameworkDeactivated(const FrameworkID& frameworkId);
+
+  // Adds a slave along with the resources each framework's tasks and
+  // executors are already using on it.
+  void slaveAdded(const SlaveID& slaveId,
+                  const Resources& resources,
+                  const hashmap<FrameworkID, Resources>& used);
+
+  void slaveRemoved(const SlaveID& slaveId);
+
+  // Like Allocator::resourcesUnused, 'filter' is the time until which
+  // the framework refuses the slave (0 meaning forever), if at all.
+  void resourcesUnused(const FrameworkID& frameworkId,
+                       const SlaveID& slaveId,
+                       const Resources& resources,
+                       const Option<double>& filter);
+
+  void resourcesRecovered(const FrameworkID& frameworkId,
+                          const SlaveID& slaveId,
+                          const Resources& resources);
+
+  void offersRevived(const FrameworkID& frameworkId);
+
+  // Returns the statistics as of the last allocation pass. Unlike
+  // the other functions this gets called directly (from any thread)
+  // rather than dispatched, so that the master doesn't have to wait
+  // for a busy allocator.
+  JSON::Object statistics() const;
+
+protected:
+  virtual void initialize();
+
+private:
+  // Allocates every 'interval' seconds.
+  void timerTick();
+
+  // Allocate if enough slaves and frameworks are dirty.
+  void batch();
+
+  // Offer the available resources on the dirty slaves.
+  void allocate();
+
+  // Account for resources allocated to (or unallocated from) a
+  // framework on a slave.
+  void allocated(const FrameworkID& frameworkId,
+                 const SlaveID& slaveId,
+                 const Resources& resources);
+
+  void unallocated(const FrameworkID& frameworkId,
+                   const SlaveID& slaveId,
+                   const Resources& resources);
+
+  const process::PID<Master> master;
+
+  const double interval;
+
+  size_t batchSize;
+
+  // Whether or not each (added) framework is active.
+  hashmap<FrameworkID, bool> frameworks;
+
+  // Total and not yet allocated resources of each slave.
+  hashmap<SlaveID, Resources> totals;
+  hashmap<SlaveID, Resources> available;
+
+  DRFSorter sorter;
+
+  // Resources allocated to each framework on each slave (offered or
+  // used by tasks and executors). This includes frameworks that
+  // haven't been added (yet) but have tasks on re-registered slaves.
+  hashmap<FrameworkID, hashmap<SlaveID, Resources> > allocations;
+
+  OfferFilters filters;
+
+  // Remember which frameworks refused each slave "recently"; this is
+  // cleared when the slave's free resources go up or when everyone
+  // has refused it.
+  Refusers refusers;
+
+  // Slaves whose free resources changed and frameworks that were
+  // added or revived since the last pass.
+  hashset<SlaveID> dirtySlaves;
+  hashset<FrameworkID> dirtyFrameworks;
+
+  // Slaves with free resources that no framework could take.
+  hashset<SlaveID> unofferedSlaves;
+
+  // Statistics about the allocation passes, updated after every pass
+  // while holding 'mutex' (see 'statistics').
+  mutable pthread_mutex_t mutex;
+
+  struct {
+    uint64_t passes;
+    uint64_t slavesConsidered; // Summed over all passes.
+    uint64_t lastSlavesConsidered;
+    double totalTime; // In seconds, as are the other times.
+    double lastTime;
+    double maxTime;
+
+    // Durations of (at most MAX_ALLOCATION_PASS_TIMES of) the most
+    // recent passes, where the duration of pass N is at index N
+    // modulo that.
+    std::vector<double> times;
+  } stats;
+};
+
+
+// The allocator the master calls into, which turns each callback into
+// a dispatch to a DRFAllocatorProcess (copying whatever it needs out
+// of the master's frameworks and slaves) so that allocating doesn't
+// take any time away from the master.
+class DRFAllocator : public Allocator
+{
+public:
+  DRFAllocator(): process(NULL) {}
+
+  virtual ~DRFAllocator();
+
+  virtual void initialize(Master* _master, const Configuration& conf);
+
+  virtual void frameworkAdded(Framework* framework);
+
+  virtual void frameworkRemoved(Framework* framework);
+
+  virtual void frameworkActivated(Framework* framework);
+
+  virtual void frameworkDeactivated(Framework* framework);
+
+  virtual void slaveAdded(Slave* slave);
+
+  virtual void slaveRemoved(Slave* slave);
+
+  virtual void resourcesRequested(
+      const FrameworkID& frameworkId,
+      const std::vector<ResourceRequest>& requests);
+
+  virtual void resourcesUnused(
+      const FrameworkID& frameworkId,
+      const SlaveID& slaveId,
+      const Resources& resources,
+      const Option<double>& filter);
+
+  virtual void resourcesRecovered(
+      const FrameworkID& frameworkId,
+      const SlaveID& slaveId,
+      const Resources& resources);
+
+  virtual void offersRevived(Framework* framework);
+
+  virtual void statistics(JSON::Object* object) const;
+
+private:
+  Master* master;
+
+  DRFAllocatorProcess* process;
+};
+
+} // namespace master {
+} // namespace internal {
+} // namespace mesos {
+
+#endif // __DRF_ALLOCATOR_HPP__
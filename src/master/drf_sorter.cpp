@@ -0,0 +1,208 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <glog/logging.h>
+
+#include <algorithm>
+
+#include "common/foreach.hpp"
+
+#include "master/drf_sorter.hpp"
+
+using std::max;
+using std::string;
+using std::vector;
+
+
+namespace mesos {
+namespace internal {
+namespace master {
+
+bool DRFSorter::ShareComparator::operator () (
+    const Client& left,
+    const Client& right) const
+{
+  if (left.share == right.share) {
+    // Make the order deterministic for unit testing.
+    return left.frameworkId.value() < right.frameworkId.value();
+  } else {
+    return left.share < right.share;
+  }
+}
+
+
+void DRFSorter::add(const FrameworkID& frameworkId)
+{
+  CHECK(!allocations.contains(frameworkId));
+  allocations[frameworkId] = Allocation();
+  clients.insert(Client(frameworkId, 0));
+}
+
+
+void DRFSorter::remove(const FrameworkID& frameworkId)
+{
+  CHECK(allocations.contains(frameworkId));
+  clients.erase(Client(frameworkId, allocations[frameworkId].share));
+  allocations.erase(frameworkId);
+}
+
+
+bool DRFSorter::contains(const FrameworkID& frameworkId) const
+{
+  return allocations.contains(frameworkId);
+}
+
+
+size_t DRFSorter::size() const
+{
+  return allocations.size();
+}
+
+
+void DRFSorter::allocated(
+    const FrameworkID& frameworkId,
+    const Resources& resources)
+{
+  CHECK(allocations.contains(frameworkId));
+  Allocation* allocation = &allocations[frameworkId];
+  allocation->resources += resources;
+  update(frameworkId, allocation);
+}
+
+
+void DRFSorter::unallocated(
+    const FrameworkID& frameworkId,
+    const Resources& resources)
+{
+  CHECK(allocations.contains(frameworkId));
+  Allocation* allocation = &allocations[frameworkId];
+  allocation->resources -= resources;
+  update(frameworkId, allocation);
+}
+
+
+const Resources& DRFSorter::allocation(const FrameworkID& frameworkId) const
+{
+  CHECK(allocations.contains(frameworkId));
+  return allocations.find(frameworkId)->second.resources;
+}
+
+
+double DRFSorter::share(const FrameworkID& frameworkId) const
+{
+  CHECK(allocations.contains(frameworkId));
+  return allocations.find(frameworkId)->second.share;
+}
+
+
+void DRFSorter::add(const Resources& _resources)
+{
+  resources += _resources;
+  updateAll();
+}
+
+
+void DRFSorter::remove(const Resources& _resources)
+{
+  resources -= _resources;
+  updateAll();
+}
+
+
+const Resources& DRFSorter::total() const
+{
+  return resources;
+}
+
+
+vector<FrameworkID> DRFSorter::sort() const
+{
+  vector<FrameworkID> result;
+  result.reserve(clients.size());
+  foreach (const Client& client, clients) {
+    result.push_back(client.frameworkId);
+  }
+  return result;
+}
+
+
+DRFSorter::const_iterator DRFSorter::begin() const
+{
+  return clients.begin();
+}
+
+
+DRFSorter::const_iterator DRFSorter::end() const
+{
+  return clients.end();
+}
+
+
+double DRFSorter::calculateShare(const Resources& _resources) const
+{
+  double share = 0;
+
+  foreach (const Resource& resource, _resources) {
+    if (resource.type() == Value::SCALAR) {
+      hashmap<string, double>::const_iterator iterator =
+        totals.find(resource.name());
+      if (iterator != totals.end() && iterator->second > 0) {
+        share = max(share, resource.scalar().value() / iterator->second);
+      }
+    }
+  }
+
+  return share;
+}
+
+
+void DRFSorter::update(const FrameworkID& frameworkId, Allocation* allocation)
+{
+  double share = calculateShare(allocation->resources);
+
+  if (share != allocation->share) {
+    clients.erase(Client(frameworkId, allocation->share));
+    allocation->share = share;
+    clients.insert(Client(frameworkId, share));
+  }
+}
+
+
+void DRFSorter::updateAll()
+{
+  totals.clear();
+
+  foreach (const Resource& resource, resources) {
+    if (resource.type() == Value::SCALAR) {
+      totals[resource.name()] = resource.scalar().value();
+    }
+  }
+
+  clients.clear();
+
+  foreachpair (const FrameworkID& frameworkId,
+               Allocation& allocation,
+               allocations) {
+    allocation.share = calculateShare(allocation.resources);
+    clients.insert(Client(frameworkId, allocation.share));
+  }
+}
+
+} // namespace master {
+} // namespace internal {
+} // namespace mesos {
@@ -0,0 +1,133 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __DRF_SORTER_HPP__
+#define __DRF_SORTER_HPP__
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include <mesos/mesos.hpp>
+
+#include "common/hashmap.hpp"
+#include "common/resources.hpp"
+#include "common/type_utils.hpp"
+
+
+namespace mesos {
+namespace internal {
+namespace master {
+
+// Keeps frameworks ordered by their dominant share (see "Dominant
+// Resource Fairness", Ghodsi et al.). Rather than computing every
+// share whenever an ordering is needed, the share of a framework is
+// updated as resources get allocated to it (or unallocated from it)
+// and the framework is moved to its new position, which costs
+// O(log F) per update. Only changing the total resources (i.e., a
+// slave being added or removed) requires updating every share. Like
+// the original comparator, only scalar resources are considered.
+class DRFSorter
+{
+public:
+  struct Client
+  {
+    Client(const FrameworkID& _frameworkId, double _share)
+      : frameworkId(_frameworkId), share(_share) {}
+
+    FrameworkID frameworkId;
+    double share;
+  };
+
+  struct ShareComparator
+  {
+    bool operator () (const Client& left, const Client& right) const;
+  };
+
+  typedef std::set<Client, ShareComparator>::const_iterator const_iterator;
+
+  void add(const FrameworkID& frameworkId);
+
+  void remove(const FrameworkID& frameworkId);
+
+  bool contains(const FrameworkID& frameworkId) const;
+
+  size_t size() const;
+
+  // Adds/removes resources to/from the allocation of a framework.
+  void allocated(const FrameworkID& frameworkId, const Resources& resources);
+
+  void unallocated(const FrameworkID& frameworkId, const Resources& resources);
+
+  const Resources& allocation(const FrameworkID& frameworkId) const;
+
+  double share(const FrameworkID& frameworkId) const;
+
+  // Adds/removes resources to/from the total that shares are
+  // calculated against.
+  void add(const Resources& resources);
+
+  void remove(const Resources& resources);
+
+  const Resources& total() const;
+
+  // Returns the frameworks in order of increasing dominant share
+  // (ties are broken by framework ID to be deterministic).
+  std::vector<FrameworkID> sort() const;
+
+  // Iterates the frameworks in the same order as 'sort' but without
+  // copying them. Note that allocating (or unallocating) resources
+  // invalidates the iterators of the framework being updated.
+  const_iterator begin() const;
+
+  const_iterator end() const;
+
+private:
+  struct Allocation
+  {
+    Allocation() : share(0) {}
+
+    Resources resources;
+    double share;
+  };
+
+  // Calculates the dominant share of an allocation against 'totals'.
+  double calculateShare(const Resources& resources) const;
+
+  // Moves a framework to the position of its new share.
+  void update(const FrameworkID& frameworkId, Allocation* allocation);
+
+  // Updates the shares of all frameworks (after the totals changed).
+  void updateAll();
+
+  std::set<Client, ShareComparator> clients;
+
+  hashmap<FrameworkID, Allocation> allocations;
+
+  Resources resources;
+
+  // Total of each scalar resource, by name, so that calculating a
+  // share doesn't need to search through 'resources'.
+  hashmap<std::string, double> totals;
+};
+
+} // namespace master {
+} // namespace internal {
+} // namespace mesos {
+
+#endif // __DRF_SORTER_HPP__
@@ -27,6 +27,7 @@
 #include "common/type_utils.hpp"
 #include "common/utils.hpp"
 
+#include "master/allocator.hpp"
 #include "master/http.hpp"
 #include "master/master.hpp"
 
@@ -205,6 +206,8 @@ Future<HttpResponse> stats(
   object.values["valid_status_updates"] = master.stats.validStatusUpdates;
   object.values["invalid_status_updates"] = master.stats.invalidStatusUpdates;
 
+  master.allocator->statistics(&object);
+
   // Get total and used (note, not offered) resources in order to
   // compute capacity of scalar resources.
   Resources totalResources;
@@ -27,7 +27,7 @@
 #include "detector/detector.hpp"
 
 #include "master/allocator.hpp"
-#include "master/simple_allocator.hpp"
+#include "master/allocator_factory.hpp"
 #include "master/master.hpp"
 #include "master/webui.hpp"
 
@@ -101,7 +101,13 @@ int main(int argc, char **argv)
     fatalerror("Could not chdir into %s", dirname(argv[0]));
   }
 
-  Allocator* allocator = new SimpleAllocator();
+  string name = conf.get("allocator", "simple");
+  Allocator* allocator = AllocatorFactory::instantiate(name, NULL);
+
+  if (allocator == NULL) {
+    cerr << "Unrecognized allocator: " << name << endl;
+    exit(1);
+  }
 
   Master* master = new Master(allocator, conf);
   process::spawn(master);
@@ -232,6 +232,22 @@ void Master::registerOptions(Configurator* configurator)
       "failover_timeout",
       "Framework failover timeout in seconds",
       FRAMEWORK_FAILOVER_TIMEOUT);
+
+  configurator->addOption<string>(
+      "allocator",
+      "Allocator to use (simple, drf)",
+      "simple");
+
+  configurator->addOption<double>(
+      "allocation_interval",
+      "Seconds between (batched) allocations and expiring offer filters",
+      1.0);
+
+  configurator->addOption<int>(
+      "allocation_batch_size",
+      "Changed slaves and frameworks that trigger an allocation\n"
+      "before the next interval (drf allocator only)",
+      16);
 }
 
 
@@ -284,7 +300,7 @@ void Master::initialize()
   slavesManager = new SlavesManager(conf, self());
   spawn(slavesManager);
 
-  allocator->initialize(this);
+  allocator->initialize(this, conf);
 
   elected = false;
 
@@ -294,6 +310,8 @@ void Master::initialize()
 
   failoverTimeout = conf.get<int>("failover_timeout", FRAMEWORK_FAILOVER_TIMEOUT);
 
+  allocationInterval = conf.get<double>("allocation_interval", 1.0);
+
   // Start all the statistics at 0.
   CHECK(TASK_STARTING == TaskState_MIN);
   CHECK(TASK_LOST == TaskState_MAX);
@@ -311,7 +329,7 @@ void Master::initialize()
   startTime = Clock::now();
 
   // Start our timer ticks.
-  timerTickTimer = delay(1.0, self(), &Master::timerTick);
+  timerTickTimer = delay(allocationInterval, self(), &Master::timerTick);
 
   // Install handler functions for certain messages.
   install<SubmitSchedulerRequest>(
@@ -433,6 +451,7 @@ void Master::exited(const UPID& pid)
 
       // Stop sending offers here for now.
       framework->active = false;
+      allocator->frameworkDeactivated(framework);
 
       // Delay dispatching a message to ourselves for the timeout.
       delay(failoverTimeout, self(),
@@ -441,10 +460,7 @@ void Master::exited(const UPID& pid)
 
       // Remove the framework's offers.
       foreach (Offer* offer, utils::copy(framework->offers)) {
-        allocator->resourcesRecovered(offer->framework_id(),
-                                      offer->slave_id(),
-                                      offer->resources());
-        removeOffer(offer);
+        recoverOffer(offer);
       }
       return;
     }
@@ -598,10 +614,7 @@ void Master::reregisterFramework(const FrameworkID& frameworkId,
       // replied to the offers but the driver might have dropped
       // those messages since it wasn't connected to the master.
       foreach (Offer* offer, utils::copy(framework->offers)) {
-        allocator->resourcesRecovered(offer->framework_id(),
-                                      offer->slave_id(),
-                                      offer->resources());
-        removeOffer(offer);
+        recoverOffer(offer);
       }
 
       FrameworkReregisteredMessage message;
@@ -619,9 +632,9 @@ void Master::reregisterFramework(const FrameworkID& frameworkId,
 
     // TODO(benh): Check for root submissions like above!
 
-    addFramework(framework);
-
-    // Add any running tasks reported by slaves for this framework.
+    // Add any running tasks reported by slaves for this framework
+    // (before adding the framework so that the allocator knows about
+    // the resources it is already using).
     foreachpair (const SlaveID& slaveId, Slave* slave, slaves) {
       foreachvalue (Task* task, slave->tasks) {
         if (framework->id == task->framework_id()) {
@@ -636,6 +649,8 @@ void Master::reregisterFramework(const FrameworkID& frameworkId,
         }
       }
     }
+
+    addFramework(framework);
   }
 
   CHECK(frameworks.count(frameworkId) > 0);
@@ -677,6 +692,7 @@ void Master::deactivateFramework(const FrameworkID& frameworkId)
   if (framework != NULL) {
     if (framework->pid == from) {
       framework->active = false;
+      allocator->frameworkDeactivated(framework);
     } else {
       LOG(WARNING) << from << " tried to deactivate framework; "
         << "expecting " << framework->pid;
@@ -740,7 +756,6 @@ void Master::reviveOffers(const FrameworkID& frameworkId)
   Framework* framework = getFramework(frameworkId);
   if (framework != NULL) {
     LOG(INFO) << "Reviving offers for framework " << framework->id;
-    framework->slaveFilter.clear();
     allocator->offersRevived(framework);
   }
 }
@@ -1088,9 +1103,17 @@ void Master::exitedExecutor(const SlaveID& slaveId,
         }
       }
 
-      // Remove executor from slave and framework.
-      slave->removeExecutor(frameworkId, executorId);
-      framework->removeExecutor(slave->id, executorId);
+      // Remove executor from slave and framework, telling the
+      // allocator about the resources the executor was using.
+      if (slave->hasExecutor(frameworkId, executorId)) {
+        Resources resources =
+          slave->executors[frameworkId][executorId].resources();
+        slave->removeExecutor(frameworkId, executorId);
+        framework->removeExecutor(slave->id, executorId);
+        allocator->resourcesRecovered(frameworkId, slaveId, resources);
+      } else {
+        framework->removeExecutor(slave->id, executorId);
+      }
 
       // TODO(benh): Send the framework it's executor's exit status?
       // Or maybe at least have something like
@@ -1133,16 +1156,11 @@ void Master::deactivatedSlaveHostnamePort(const string& hostname,
 
 void Master::timerTick()
 {
-  // Check which framework filters can be expired.
-  foreachvalue (Framework* framework, frameworks) {
-    framework->removeExpiredFilters(Clock::now());
-  }
-
-  // Do allocations!
+  // Do allocations (and expire filters)!
   allocator->timerTick();
 
   // Scheduler another timer tick!
-  timerTickTimer = delay(1.0, self(), &Master::timerTick);
+  timerTickTimer = delay(allocationInterval, self(), &Master::timerTick);
 }
 
 
@@ -1200,6 +1218,35 @@ void Master::makeOffers(Framework* framework,
 }
 
 
+void Master::offer(const FrameworkID& frameworkId,
+                   const hashmap<SlaveID, Resources>& offered)
+{
+  Framework* framework = getFramework(frameworkId);
+
+  hashmap<Slave*, Resources> resources;
+
+  foreachpair (const SlaveID& slaveId, const Resources& r, offered) {
+    Slave* slave = getSlave(slaveId);
+
+    // The allocator's view of the slave and framework might be behind
+    // ours, in which case we give the resources right back.
+    if (framework == NULL || !framework->active ||
+        slave == NULL || !slave->active ||
+        !(r <= slave->resourcesFree())) {
+      LOG(INFO) << "Recovering " << r << " on slave " << slaveId
+                << " offered to framework " << frameworkId;
+      allocator->resourcesRecovered(frameworkId, slaveId, r);
+    } else {
+      resources[slave] = r;
+    }
+  }
+
+  if (!resources.empty()) {
+    makeOffers(framework, resources);
+  }
+}
+
+
 // We use the visitor pattern to abstract the process of performing
 // any validations, aggregations, etc. of tasks that a framework
 // attempts to run within the resources provided by an offer. A
@@ -1402,27 +1449,27 @@ void Master::processTasks(Offer* offer,
   // Calculate unused resources.
   Resources unusedResources = offer->resources() - usedResources;
 
-  if (unusedResources.allocatable().size() > 0) {
-    // Tell the allocator about the unused (e.g., refused) resources.
-    allocator->resourcesUnused(offer->framework_id(),
-                               offer->slave_id(),
-                               unusedResources);
-  }
-
-  // TODO(benh): Move all filter logic to the allocators!
-
   // Get the timeout (if it exists) for re-offering refused resources.
   double timeout = filters.has_refuse_seconds()
     ? filters.refuse_seconds()
     : UNUSED_RESOURCES_TIMEOUT;
 
-  // Only add a filter on a slave if none of the resources are used.
+  // Only have the allocator filter the slave if none of the
+  // resources are used.
+  Option<double> filter = Option<double>::none();
+
   if (timeout != 0 && usedResources.size() == 0) {
     LOG(INFO) << "Filtered slave " << slave->id
               << " for framework " << framework->id
               << " for " << timeout << " seconds";
-    framework->slaveFilter[slave] =
-      (timeout == -1) ? 0 : Clock::now() + timeout;
+    filter = Option<double>::some(
+        (timeout == -1) ? 0 : Clock::now() + timeout);
+  }
+
+  if (unusedResources.allocatable().size() > 0) {
+    // Tell the allocator about the unused (e.g., refused) resources.
+    allocator->resourcesUnused(
+        framework->id, slave->id, unusedResources, filter);
   }
 
   removeOffer(offer);
@@ -1525,6 +1572,7 @@ void Master::failoverFramework(Framework* framework, const UPID& newPid)
 
   // Make sure we can get offers again.
   framework->active = true;
+  allocator->frameworkActivated(framework);
 
   framework->reregisteredTime = Clock::now();
 
@@ -1540,10 +1588,7 @@ void Master::failoverFramework(Framework* framework, const UPID& newPid)
   // these resources to this framework if it wants.
   // TODO(benh): Consider just reoffering these to
   foreach (Offer* offer, utils::copy(framework->offers)) {
-    allocator->resourcesRecovered(offer->framework_id(),
-                                  offer->slave_id(),
-                                  offer->resources());
-    removeOffer(offer);
+    recoverOffer(offer);
   }
 }
 
@@ -1551,6 +1596,7 @@ void Master::failoverFramework(Framework* framework, const UPID& newPid)
 void Master::removeFramework(Framework* framework)
 {
   framework->active = false;
+  allocator->frameworkDeactivated(framework);
   // TODO: Notify allocator that a framework removal is beginning?
 
   // Tell slaves to shutdown the framework.
@@ -1569,10 +1615,7 @@ void Master::removeFramework(Framework* framework)
 
   // Remove the framework's offers (if they weren't removed before).
   foreach (Offer* offer, utils::copy(framework->offers)) {
-    allocator->resourcesRecovered(offer->framework_id(),
-                                  offer->slave_id(),
-                                  offer->resources());
-    removeOffer(offer);
+    recoverOffer(offer);
   }
 
   // Remove the framework's executors for correct resource accounting.
@@ -1637,7 +1680,11 @@ void Master::addSlave(Slave* slave, bool reregister)
                                       slave->id, self());
   spawn(slave->observer);
 
-  allocator->slaveAdded(slave);
+  // A re-registering slave gets added to the allocator once its
+  // tasks have been added (see Master::readdSlave).
+  if (!reregister) {
+    allocator->slaveAdded(slave);
+  }
 }
 
 
@@ -1694,6 +1741,8 @@ void Master::readdSlave(Slave* slave,
                    << " running on slave " << slave->id;
     }
   }
+
+  allocator->slaveAdded(slave);
 }
 
 
@@ -1748,11 +1797,6 @@ void Master::removeSlave(Slave* slave)
     }
   }
 
-  // Remove slave from any filters.
-  foreachvalue (Framework* framework, frameworks) {
-    framework->slaveFilter.erase(slave);
-  }
-
   // Send lost-slave message to all frameworks (this helps them re-run
   // previously finished tasks whose output was on the lost slave).
   foreachvalue (Framework* framework, frameworks) {
@@ -1824,6 +1868,18 @@ void Master::removeOffer(Offer* offer, bool rescind)
 }
 
 
+void Master::recoverOffer(Offer* offer)
+{
+  const FrameworkID frameworkId = offer->framework_id();
+  const SlaveID slaveId = offer->slave_id();
+  const Resources resources = offer->resources();
+
+  removeOffer(offer);
+
+  allocator->resourcesRecovered(frameworkId, slaveId, resources);
+}
+
+
 Framework* Master::getFramework(const FrameworkID& frameworkId)
 {
   if (frameworks.count(frameworkId) > 0) {
@@ -119,6 +119,12 @@ public:
   void makeOffers(Framework* framework,
                   const hashmap<Slave*, Resources>& offered);
 
+  // Like makeOffers but for allocators that run in their own process
+  // (and thus might offer resources of frameworks or slaves that have
+  // since gone away, which get recovered instead).
+  void offer(const FrameworkID& frameworkId,
+             const hashmap<SlaveID, Resources>& offered);
+
 protected:
   virtual void initialize();
   virtual void finalize();
@@ -166,6 +172,10 @@ protected:
   // Remove an offer and optionally rescind the offer as well.
   void removeOffer(Offer* offer, bool rescind = false);
 
+  // Remove an offer and give its resources back to the allocator
+  // (after removing it, so the allocator sees them as free).
+  void recoverOffer(Offer* offer);
+
   Framework* getFramework(const FrameworkID& frameworkId);
   Slave* getSlave(const SlaveID& slaveId);
   Offer* getOffer(const OfferID& offerId);
@@ -178,6 +188,7 @@ private:
 
   // TODO(benh): Remove once SimpleAllocator doesn't use Master::get*.
   friend class SimpleAllocator;
+  friend class DRFAllocator;
   friend struct SlaveRegistrar;
   friend struct SlaveReregistrar;
 
@@ -215,6 +226,8 @@ private:
 
   double failoverTimeout; // Failover timeout for frameworks, in seconds.
 
+  double allocationInterval; // Seconds between timer ticks.
+
   int64_t nextFrameworkId; // Used to give each framework a unique ID.
   int64_t nextOfferId;     // Used to give each slot offer a unique ID.
   int64_t nextSlaveId;     // Used to give each slave a unique ID.
@@ -460,21 +473,6 @@ struct Framework
     }
   }
 
-  bool filters(Slave* slave, Resources resources)
-  {
-    // TODO: Implement other filters
-    return slaveFilter.find(slave) != slaveFilter.end();
-  }
-
-  void removeExpiredFilters(double now)
-  {
-    foreachpair (Slave* slave, double removalTime, utils::copy(slaveFilter)) {
-      if (removalTime != 0 && removalTime <= now) {
-        slaveFilter.erase(slave);
-      }
-    }
-  }
-
   const FrameworkID id;
   const FrameworkInfo info;
 
@@ -494,10 +492,6 @@ struct Framework
   Resources resources; // Total resources (tasks + offers + executors).
 
   hashmap<SlaveID, hashmap<ExecutorID, ExecutorInfo> > executors;
-
-  // Contains a time of unfiltering for each slave we've filtered,
-  // or 0 for slaves that we want to keep filtered forever
-  hashmap<Slave*, double> slaveFilter;
 };
 
 } // namespace master {
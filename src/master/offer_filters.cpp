@@ -0,0 +1,207 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "common/foreach.hpp"
+
+#include "master/offer_filters.hpp"
+
+
+namespace mesos {
+namespace internal {
+namespace master {
+
+void OfferFilters::add(
+    const FrameworkID& frameworkId,
+    const SlaveID& slaveId,
+    const Resources& resources,
+    double expires)
+{
+  Filter filter;
+  filter.resources = resources;
+  filter.expires = expires;
+  filter.id = nextId++;
+
+  frameworks[frameworkId][slaveId] = filter;
+  slaves[slaveId].insert(frameworkId);
+
+  if (expires != 0) {
+    expirations.push(Expiration(expires, frameworkId, slaveId, filter.id));
+  }
+}
+
+
+bool OfferFilters::filtered(
+    const FrameworkID& frameworkId,
+    const SlaveID& slaveId,
+    const Resources& resources) const
+{
+  hashmap<FrameworkID, hashmap<SlaveID, Filter> >::const_iterator iterator =
+    frameworks.find(frameworkId);
+
+  if (iterator != frameworks.end()) {
+    hashmap<SlaveID, Filter>::const_iterator filter =
+      iterator->second.find(slaveId);
+    if (filter != iterator->second.end()) {
+      return resources <= filter->second.resources;
+    }
+  }
+
+  return false;
+}
+
+
+void OfferFilters::remove(
+    const FrameworkID& frameworkId,
+    const SlaveID& slaveId)
+{
+  if (frameworks.contains(frameworkId)) {
+    frameworks[frameworkId].erase(slaveId);
+    if (frameworks[frameworkId].empty()) {
+      frameworks.erase(frameworkId);
+    }
+  }
+
+  if (slaves.contains(slaveId)) {
+    slaves[slaveId].erase(frameworkId);
+    if (slaves[slaveId].empty()) {
+      slaves.erase(slaveId);
+    }
+  }
+}
+
+
+void OfferFilters::remove(const FrameworkID& frameworkId)
+{
+  if (frameworks.contains(frameworkId)) {
+    foreachkey (const SlaveID& slaveId, frameworks[frameworkId]) {
+      slaves[slaveId].erase(frameworkId);
+      if (slaves[slaveId].empty()) {
+        slaves.erase(slaveId);
+      }
+    }
+    frameworks.erase(frameworkId);
+  }
+}
+
+
+void OfferFilters::remove(const SlaveID& slaveId)
+{
+  if (slaves.contains(slaveId)) {
+    foreach (const FrameworkID& frameworkId, slaves[slaveId]) {
+      frameworks[frameworkId].erase(slaveId);
+      if (frameworks[frameworkId].empty()) {
+        frameworks.erase(frameworkId);
+      }
+    }
+    slaves.erase(slaveId);
+  }
+}
+
+
+size_t OfferFilters::expire(double now)
+{
+  size_t expired = 0;
+
+  while (!expirations.empty() && expirations.top().time <= now) {
+    const Expiration& expiration = expirations.top();
+
+    // Only remove the filter if it's the one this entry is for (and
+    // not one that replaced it or has been removed already).
+    if (frameworks.contains(expiration.frameworkId) &&
+        frameworks[expiration.frameworkId].contains(expiration.slaveId) &&
+        frameworks[expiration.frameworkId][expiration.slaveId].id ==
+          expiration.id) {
+      remove(expiration.frameworkId, expiration.slaveId);
+      expired++;
+    }
+
+    expirations.pop();
+  }
+
+  return expired;
+}
+
+
+size_t OfferFilters::size() const
+{
+  size_t size = 0;
+  foreachvalue (const hashset<FrameworkID>& frameworkIds, slaves) {
+    size += frameworkIds.size();
+  }
+  return size;
+}
+
+
+void Refusers::add(const SlaveID& slaveId, const FrameworkID& frameworkId)
+{
+  frameworks[slaveId].insert(frameworkId);
+  slaves[frameworkId].insert(slaveId);
+}
+
+
+bool Refusers::contains(
+    const SlaveID& slaveId,
+    const FrameworkID& frameworkId) const
+{
+  hashmap<SlaveID, hashset<FrameworkID> >::const_iterator iterator =
+    frameworks.find(slaveId);
+
+  return iterator != frameworks.end() &&
+    iterator->second.contains(frameworkId);
+}
+
+
+size_t Refusers::count(const SlaveID& slaveId) const
+{
+  hashmap<SlaveID, hashset<FrameworkID> >::const_iterator iterator =
+    frameworks.find(slaveId);
+
+  return iterator != frameworks.end() ? iterator->second.size() : 0;
+}
+
+
+void Refusers::remove(const SlaveID& slaveId)
+{
+  if (frameworks.contains(slaveId)) {
+    foreach (const FrameworkID& frameworkId, frameworks[slaveId]) {
+      slaves[frameworkId].erase(slaveId);
+      if (slaves[frameworkId].empty()) {
+        slaves.erase(frameworkId);
+      }
+    }
+    frameworks.erase(slaveId);
+  }
+}
+
+
+void Refusers::remove(const FrameworkID& frameworkId)
+{
+  if (slaves.contains(frameworkId)) {
+    foreach (const SlaveID& slaveId, slaves[frameworkId]) {
+      frameworks[slaveId].erase(frameworkId);
+      if (frameworks[slaveId].empty()) {
+        frameworks.erase(slaveId);
+      }
+    }
+    slaves.erase(frameworkId);
+  }
+}
+
+} // namespace master {
+} // namespace internal {
+} // namespace mesos {
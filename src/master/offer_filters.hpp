@@ -0,0 +1,152 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __OFFER_FILTERS_HPP__
+#define __OFFER_FILTERS_HPP__
+
+#include <stdint.h>
+
+#include <queue>
+#include <vector>
+
+#include <mesos/mesos.hpp>
+
+#include "common/hashmap.hpp"
+#include "common/hashset.hpp"
+#include "common/resources.hpp"
+#include "common/type_utils.hpp"
+
+
+namespace mesos {
+namespace internal {
+namespace master {
+
+// The filters that frameworks install when they leave the resources
+// of an offer unused (see Filters in mesos.proto). Until a filter
+// expires (if ever) the framework doesn't get offered those resources
+// on that slave again, nor any subset of them (more resources might
+// well be of use to the framework).
+//
+// The filters are indexed by framework and by slave, so that removing
+// the filters of a framework (e.g., when it revives offers) or of a
+// slave only touches those filters. The expiration times are kept in
+// a min-heap, so expiring filters costs nothing unless some filter
+// actually expires.
+class OfferFilters
+{
+public:
+  OfferFilters() : nextId(0) {}
+
+  // Filters 'resources' on a slave for a framework until 'expires'
+  // (0 meaning forever), replacing any filter it already had there.
+  void add(const FrameworkID& frameworkId,
+           const SlaveID& slaveId,
+           const Resources& resources,
+           double expires);
+
+  // Returns true if the framework has a filter on the slave that
+  // covers all of 'resources'.
+  bool filtered(const FrameworkID& frameworkId,
+                const SlaveID& slaveId,
+                const Resources& resources) const;
+
+  void remove(const FrameworkID& frameworkId, const SlaveID& slaveId);
+
+  // Removes all the filters of a framework or on a slave.
+  void remove(const FrameworkID& frameworkId);
+
+  void remove(const SlaveID& slaveId);
+
+  // Removes the filters that expire at or before 'now' and returns
+  // how many there were.
+  size_t expire(double now);
+
+  size_t size() const;
+
+private:
+  struct Filter
+  {
+    Resources resources;
+    double expires;
+    uint64_t id; // Tells a filter from the one it replaced.
+  };
+
+  struct Expiration
+  {
+    Expiration(double _time,
+               const FrameworkID& _frameworkId,
+               const SlaveID& _slaveId,
+               uint64_t _id)
+      : time(_time), frameworkId(_frameworkId), slaveId(_slaveId), id(_id) {}
+
+    double time;
+    FrameworkID frameworkId;
+    SlaveID slaveId;
+    uint64_t id;
+  };
+
+  struct Later
+  {
+    bool operator () (const Expiration& left, const Expiration& right) const
+    {
+      return left.time > right.time;
+    }
+  };
+
+  hashmap<FrameworkID, hashmap<SlaveID, Filter> > frameworks;
+
+  // The frameworks with a filter on each slave.
+  hashmap<SlaveID, hashset<FrameworkID> > slaves;
+
+  // Filters that get replaced or removed keep their entry here until
+  // it would have expired (the ids tell they're gone), which saves
+  // having to find the entry in the heap.
+  std::priority_queue<Expiration, std::vector<Expiration>, Later> expirations;
+
+  uint64_t nextId;
+};
+
+
+// Remembers which frameworks refused the resources on each slave
+// "recently" (this gets cleared when the slave's free resources go up
+// or when everyone has refused them). Indexed both ways so that
+// forgetting a framework doesn't require looking at every slave.
+class Refusers
+{
+public:
+  void add(const SlaveID& slaveId, const FrameworkID& frameworkId);
+
+  bool contains(const SlaveID& slaveId, const FrameworkID& frameworkId) const;
+
+  // Returns the number of frameworks that refused the slave.
+  size_t count(const SlaveID& slaveId) const;
+
+  void remove(const SlaveID& slaveId);
+
+  void remove(const FrameworkID& frameworkId);
+
+private:
+  hashmap<SlaveID, hashset<FrameworkID> > frameworks;
+  hashmap<FrameworkID, hashset<SlaveID> > slaves;
+};
+
+} // namespace master {
+} // namespace internal {
+} // namespace mesos {
+
+#endif // __OFFER_FILTERS_HPP__
@@ -20,10 +20,14 @@
 
 #include <algorithm>
 
+#include <process/clock.hpp>
+
 #include "common/utils.hpp"
 
 #include "master/simple_allocator.hpp"
 
+using process::Clock;
+
 using std::max;
 using std::sort;
 using std::vector;
@@ -33,7 +37,7 @@ namespace mesos {
 namespace internal {
 namespace master {
 
-void SimpleAllocator::initialize(Master* _master)
+void SimpleAllocator::initialize(Master* _master, const Configuration& conf)
 {
   master = _master;
   initialized = true;
@@ -52,9 +56,8 @@ void SimpleAllocator::frameworkRemoved(Framework* framework)
 {
   CHECK(initialized);
 
-  foreachkey (const SlaveID& slaveId, utils::copy(refusers)) {
-    refusers.remove(slaveId, framework->id);
-  }
+  refusers.remove(framework->id);
+  filters.remove(framework->id);
 
   LOG(INFO) << "Removed framework " << framework->id;
 
@@ -82,6 +85,7 @@ void SimpleAllocator::slaveRemoved(Slave* slave)
 
   totalResources -= slave->info.resources();
   refusers.remove(slave->id);
+  filters.remove(slave->id);
 }
 
 
@@ -98,7 +102,8 @@ void SimpleAllocator::resourcesRequested(
 void SimpleAllocator::resourcesUnused(
     const FrameworkID& frameworkId,
     const SlaveID& slaveId,
-    const Resources& resources)
+    const Resources& resources,
+    const Option<double>& filter)
 {
   CHECK(initialized);
 
@@ -106,7 +111,11 @@ void SimpleAllocator::resourcesUnused(
     VLOG(1) << "Framework " << frameworkId
             << " left " << resources.allocatable()
             << " unused on slave " << slaveId;
-    refusers.put(slaveId, frameworkId);
+    refusers.add(slaveId, frameworkId);
+  }
+
+  if (filter.isSome()) {
+    filters.add(frameworkId, slaveId, resources, filter.get());
   }
 
   makeNewOffers();
@@ -135,13 +144,10 @@ void SimpleAllocator::offersRevived(Framework* framework)
 {
   CHECK(initialized);
 
-  // TODO(benh): This is broken ... we say filters removed here, but
-  // yet we don't actually do the removing of the filters? The
-  // allocator should really be responsible for filters (if there are
-  // any) because it can best use those for future allocation
-  // decisions.
   LOG(INFO) << "Filters removed for framework " << framework->id;
 
+  filters.remove(framework->id);
+
   makeNewOffers();
 }
 
@@ -237,6 +243,8 @@ void SimpleAllocator::makeNewOffers(const vector<Slave*>& slaves)
     return;
   }
 
+  filters.expire(Clock::now());
+
   // Find all the available resources that can be allocated.
   hashmap<Slave*, Resources> available;
   foreach (Slave* slave, slaves) {
@@ -274,7 +282,7 @@ void SimpleAllocator::makeNewOffers(const vector<Slave*>& slaves)
 
   // Clear refusers on any slave that has been refused by everyone.
   foreachkey (Slave* slave, available) {
-    if (refusers.get(slave->id).size() == ordering.size()) {
+    if (refusers.count(slave->id) == ordering.size()) {
       VLOG(1) << "Clearing refusers for slave " << slave->id
               << " because EVERYONE has refused resources from it";
       refusers.remove(slave->id);
@@ -286,7 +294,7 @@ void SimpleAllocator::makeNewOffers(const vector<Slave*>& slaves)
     hashmap<Slave*, Resources> offerable;
     foreachpair (Slave* slave, const Resources& resources, available) {
       if (!refusers.contains(slave->id, framework->id) &&
-          !framework->filters(slave, resources)) {
+          !filters.filtered(framework->id, slave->id, resources)) {
         VLOG(1) << "Offering " << resources
                 << " on slave " << slave->id
                 << " to framework " << framework->id;
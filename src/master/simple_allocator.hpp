@@ -22,9 +22,9 @@
 #include <vector>
 
 #include "common/hashmap.hpp"
-#include "common/multihashmap.hpp"
 
 #include "master/allocator.hpp"
+#include "master/offer_filters.hpp"
 
 
 namespace mesos {
@@ -38,7 +38,7 @@ public:
 
   virtual ~SimpleAllocator() {}
 
-  virtual void initialize(Master* _master);
+  virtual void initialize(Master* _master, const Configuration& conf);
 
   virtual void frameworkAdded(Framework* framework);
 
@@ -55,7 +55,8 @@ public:
   virtual void resourcesUnused(
     const FrameworkID& frameworkId,
     const SlaveID& slaveId,
-    const Resources& resources);
+    const Resources& resources,
+    const Option<double>& filter);
 
   virtual void resourcesRecovered(
     const FrameworkID& frameworkId,
@@ -88,7 +89,9 @@ private:
   // Remember which frameworks refused each slave "recently"; this is
   // cleared when the slave's free resources go up or when everyone
   // has refused it.
-  multihashmap<SlaveID, FrameworkID> refusers;
+  Refusers refusers;
+
+  OfferFilters filters;
 };
 
 } // namespace master {
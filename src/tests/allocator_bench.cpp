@@ -0,0 +1,833 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/lexical_cast.hpp>
+
+#include <process/dispatch.hpp>
+#include <process/process.hpp>
+#include <process/protobuf.hpp>
+#include <process/timer.hpp>
+
+#include "common/foreach.hpp"
+#include "common/hashmap.hpp"
+#include "common/json.hpp"
+#include "common/lock.hpp"
+#include "common/resources.hpp"
+#include "common/strings.hpp"
+#include "common/timer.hpp"
+#include "common/utils.hpp"
+#include "common/uuid.hpp"
+
+#include "configurator/configurator.hpp"
+
+#include "detector/detector.hpp"
+
+#include "master/allocator.hpp"
+#include "master/allocator_factory.hpp"
+#include "master/drf_sorter.hpp"
+#include "master/master.hpp"
+
+#include "messages/messages.hpp"
+
+using namespace mesos;
+using namespace mesos::internal;
+
+using mesos::internal::master::Allocator;
+using mesos::internal::master::AllocatorFactory;
+using mesos::internal::master::DRFSorter;
+using mesos::internal::master::Framework;
+using mesos::internal::master::Master;
+using mesos::internal::master::Slave;
+
+using mesos::internal::utils::stringify;
+
+using process::Clock;
+using process::Future;
+using process::PID;
+using process::UPID;
+
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+
+
+// Simulates a cluster inside a single process in order to measure how
+// an allocator behaves at scale without having to run a cluster. A
+// real master (using the allocator being measured) gets driven by
+// simulated slaves and frameworks that speak the usual protocol with
+// it but don't run anything: slaves just report each task as finished
+// once its duration is up, and frameworks launch as many tasks of
+// their resource shape as fit in each offer (unless they refuse it).
+//
+// After all slaves and frameworks have registered the simulation runs
+// for 'duration' seconds, after which the results get printed as a
+// JSON object on a single line, for example:
+//
+//   {"allocator":"simple","num_slaves":1000,...,"offers_per_sec":...}
+//
+// The latency of every call into the allocator is measured, which for
+// an allocator that allocates synchronously (e.g., the SimpleAllocator)
+// is the latency of its allocation passes. Allocators that allocate
+// asynchronously (e.g., the DRFAllocator) only spend the time to
+// dispatch in those calls, so they report the percentiles of their
+// own (most recent) allocation passes, which get included in the
+// results instead.
+
+
+// Counts what the simulated slaves and frameworks do (updated
+// atomically since they run concurrently).
+struct Counters
+{
+  Counters()
+    : slavesRegistered(0),
+      frameworksRegistered(0),
+      offers(0),
+      refused(0),
+      launched(0),
+      finished(0) {}
+
+  volatile long slavesRegistered;
+  volatile long frameworksRegistered;
+  volatile long offers;
+  volatile long refused;
+  volatile long launched;
+  volatile long finished;
+};
+
+
+static void increment(volatile long* counter, long n = 1)
+{
+  __sync_fetch_and_add(counter, n);
+}
+
+
+// Forwards every call to another allocator, measuring how long each
+// call takes while 'timing' is set.
+class TimedAllocator : public Allocator
+{
+public:
+  explicit TimedAllocator(Allocator* _allocator)
+    : allocator(_allocator), timing(false)
+  {
+    pthread_mutex_init(&mutex, NULL);
+  }
+
+  virtual ~TimedAllocator()
+  {
+    pthread_mutex_destroy(&mutex);
+  }
+
+  virtual void initialize(Master* master, const Configuration& conf)
+  {
+    allocator->initialize(master, conf);
+  }
+
+  virtual void frameworkAdded(Framework* framework)
+  {
+    Sample sample(this);
+    allocator->frameworkAdded(framework);
+  }
+
+  virtual void frameworkRemoved(Framework* framework)
+  {
+    Sample sample(this);
+    allocator->frameworkRemoved(framework);
+  }
+
+  virtual void frameworkActivated(Framework* framework)
+  {
+    Sample sample(this);
+    allocator->frameworkActivated(framework);
+  }
+
+  virtual void frameworkDeactivated(Framework* framework)
+  {
+    Sample sample(this);
+    allocator->frameworkDeactivated(framework);
+  }
+
+  virtual void slaveAdded(Slave* slave)
+  {
+    Sample sample(this);
+    allocator->slaveAdded(slave);
+  }
+
+  virtual void slaveRemoved(Slave* slave)
+  {
+    Sample sample(this);
+    allocator->slaveRemoved(slave);
+  }
+
+  virtual void resourcesRequested(
+      const FrameworkID& frameworkId,
+      const vector<ResourceRequest>& requests)
+  {
+    Sample sample(this);
+    allocator->resourcesRequested(frameworkId, requests);
+  }
+
+  virtual void resourcesUnused(
+      const FrameworkID& frameworkId,
+      const SlaveID& slaveId,
+      const Resources& resources,
+      const Option<double>& filter)
+  {
+    Sample sample(this);
+    allocator->resourcesUnused(frameworkId, slaveId, resources, filter);
+  }
+
+  virtual void resourcesRecovered(
+      const FrameworkID& frameworkId,
+      const SlaveID& slaveId,
+      const Resources& resources)
+  {
+    Sample sample(this);
+    allocator->resourcesRecovered(frameworkId, slaveId, resources);
+  }
+
+  virtual void offersRevived(Framework* framework)
+  {
+    Sample sample(this);
+    allocator->offersRevived(framework);
+  }
+
+  virtual void timerTick()
+  {
+    Sample sample(this);
+    allocator->timerTick();
+  }
+
+  virtual void statistics(JSON::Object* object) const
+  {
+    allocator->statistics(object);
+  }
+
+  void start()
+  {
+    Lock lock(&mutex);
+    timing = true;
+  }
+
+  // Stops timing and returns the latencies of the calls so far.
+  vector<double> stop()
+  {
+    Lock lock(&mutex);
+    timing = false;
+    return samples;
+  }
+
+private:
+  class Sample;
+  friend class Sample;
+
+  // Measures the lifetime of a call.
+  class Sample
+  {
+  public:
+    explicit Sample(TimedAllocator* _allocator) : allocator(_allocator)
+    {
+      timer.start();
+    }
+
+    ~Sample()
+    {
+      Lock lock(&allocator->mutex);
+      if (allocator->timing) {
+        allocator->samples.push_back(timer.elapsed().secs());
+      }
+    }
+
+  private:
+    TimedAllocator* allocator;
+    Timer timer;
+  };
+
+  Allocator* allocator;
+
+  // Protects 'timing' and 'samples', since the master calls into the
+  // allocator from whichever thread it's running on.
+  pthread_mutex_t mutex;
+  bool timing;
+  vector<double> samples; // In seconds.
+};
+
+
+class SimulatedSlave : public ProtobufProcess<SimulatedSlave>
+{
+public:
+  SimulatedSlave(const string& id,
+                 const UPID& _master,
+                 const SlaveInfo& _info,
+                 Counters* _counters)
+    : ProtobufProcess<SimulatedSlave>(id),
+      master(_master),
+      info(_info),
+      counters(_counters) {}
+
+  virtual ~SimulatedSlave() {}
+
+protected:
+  virtual void initialize()
+  {
+    install<SlaveRegisteredMessage>(
+        &SimulatedSlave::registered,
+        &SlaveRegisteredMessage::slave_id);
+
+    install<RunTaskMessage>(
+        &SimulatedSlave::runTask,
+        &RunTaskMessage::framework_id,
+        &RunTaskMessage::task);
+
+    install("PING", &SimulatedSlave::ping);
+
+    RegisterSlaveMessage message;
+    message.mutable_slave()->MergeFrom(info);
+    send(master, message);
+  }
+
+  void registered(const SlaveID& _slaveId)
+  {
+    slaveId = _slaveId;
+    increment(&counters->slavesRegistered);
+  }
+
+  void runTask(const FrameworkID& frameworkId, const TaskDescription& task)
+  {
+    // The framework decides how long its tasks run for.
+    double duration = boost::lexical_cast<double>(task.data());
+
+    delay(duration, self(), &SimulatedSlave::finished,
+          frameworkId, task.task_id());
+  }
+
+  void finished(const FrameworkID& frameworkId, const TaskID& taskId)
+  {
+    StatusUpdateMessage message;
+    StatusUpdate* update = message.mutable_update();
+    update->mutable_framework_id()->MergeFrom(frameworkId);
+    update->mutable_slave_id()->MergeFrom(slaveId);
+    TaskStatus* status = update->mutable_status();
+    status->mutable_task_id()->MergeFrom(taskId);
+    status->set_state(TASK_FINISHED);
+    update->set_timestamp(Clock::now());
+    update->set_uuid(UUID::random().toBytes());
+    message.set_pid(self());
+    send(master, message);
+  }
+
+  void ping(const UPID& from, const string& body)
+  {
+    send(from, "PONG");
+  }
+
+private:
+  const UPID master;
+  const SlaveInfo info;
+  Counters* counters;
+  SlaveID slaveId;
+};
+
+
+class SimulatedFramework : public ProtobufProcess<SimulatedFramework>
+{
+public:
+  SimulatedFramework(const string& id,
+                     const UPID& _master,
+                     const FrameworkInfo& _info,
+                     const Resources& _shape,
+                     const Configuration& conf,
+                     unsigned int _seed,
+                     Counters* _counters)
+    : ProtobufProcess<SimulatedFramework>(id),
+      master(_master),
+      info(_info),
+      shape(_shape),
+      duration(conf.get<double>("task_duration", 10.0)),
+      refusalRate(conf.get<double>("refusal_rate", 0.1)),
+      refuseSeconds(conf.get<double>("refuse_seconds", 5.0)),
+      maxTasks(conf.get<int>("max_tasks", 0)),
+      seed(_seed),
+      counters(_counters),
+      nextTaskId(0) {}
+
+  virtual ~SimulatedFramework() {}
+
+  // Returns the resources used by the framework's running tasks.
+  Resources used()
+  {
+    return resources;
+  }
+
+protected:
+  virtual void initialize()
+  {
+    install<FrameworkRegisteredMessage>(
+        &SimulatedFramework::registered,
+        &FrameworkRegisteredMessage::framework_id);
+
+    install<ResourceOffersMessage>(
+        &SimulatedFramework::resourceOffers,
+        &ResourceOffersMessage::offers);
+
+    install<StatusUpdateMessage>(
+        &SimulatedFramework::statusUpdate,
+        &StatusUpdateMessage::update);
+
+    RegisterFrameworkMessage message;
+    message.mutable_framework()->MergeFrom(info);
+    send(master, message);
+  }
+
+  void registered(const FrameworkID& _frameworkId)
+  {
+    frameworkId = _frameworkId;
+    increment(&counters->frameworksRegistered);
+  }
+
+  void resourceOffers(const vector<Offer>& offers)
+  {
+    increment(&counters->offers, offers.size());
+
+    foreach (const Offer& offer, offers) {
+      vector<TaskDescription> tasks;
+
+      if (random() >= refusalRate) {
+        Resources remaining = offer.resources();
+
+        while (shape <= remaining &&
+               (maxTasks == 0 || running.size() < (size_t) maxTasks)) {
+          TaskDescription task;
+          task.set_name("");
+          task.mutable_task_id()->set_value(stringify(nextTaskId++));
+          task.mutable_slave_id()->MergeFrom(offer.slave_id());
+          task.mutable_resources()->MergeFrom(shape);
+          task.set_data(stringify(duration * (0.5 + random())));
+          tasks.push_back(task);
+
+          running[task.task_id().value()] = shape;
+          resources += shape;
+          remaining -= shape;
+        }
+      }
+
+      if (tasks.empty()) {
+        increment(&counters->refused);
+      } else {
+        increment(&counters->launched, tasks.size());
+      }
+
+      LaunchTasksMessage message;
+      message.mutable_framework_id()->MergeFrom(frameworkId);
+      message.mutable_offer_id()->MergeFrom(offer.id());
+      foreach (const TaskDescription& task, tasks) {
+        message.add_tasks()->MergeFrom(task);
+      }
+      message.mutable_filters()->set_refuse_seconds(refuseSeconds);
+      send(master, message);
+    }
+  }
+
+  void statusUpdate(const StatusUpdate& update)
+  {
+    const TaskStatus& status = update.status();
+
+    if (status.state() == TASK_FINISHED ||
+        status.state() == TASK_FAILED ||
+        status.state() == TASK_KILLED ||
+        status.state() == TASK_LOST) {
+      const string& taskId = status.task_id().value();
+      if (running.contains(taskId)) {
+        resources -= running[taskId];
+        running.erase(taskId);
+      }
+
+      if (status.state() == TASK_FINISHED) {
+        increment(&counters->finished);
+      }
+    }
+  }
+
+private:
+  // Returns a random number in [0, 1).
+  double random()
+  {
+    return rand_r(&seed) / (RAND_MAX + 1.0);
+  }
+
+  const UPID master;
+  const FrameworkInfo info;
+  const Resources shape;
+  const double duration;
+  const double refusalRate;
+  const double refuseSeconds;
+  const int maxTasks;
+  unsigned int seed;
+  Counters* counters;
+
+  FrameworkID frameworkId;
+  int nextTaskId;
+
+  // Resources of each running task, and all of them together.
+  hashmap<string, Resources> running;
+  Resources resources;
+};
+
+
+// Returns a field (in kilobytes) of /proc/self/status, e.g., "VmRSS",
+// or 0 if it's not available.
+static long memory(const string& field)
+{
+  std::ifstream status("/proc/self/status");
+
+  string line;
+  while (std::getline(status, line)) {
+    if (line.find(field + ":") == 0) {
+      vector<string> tokens = strings::split(line, ": \t");
+      if (tokens.size() >= 2) {
+        return boost::lexical_cast<long>(tokens[1]);
+      }
+    }
+  }
+
+  return 0;
+}
+
+
+// Returns the given percentile of sorted values.
+static double percentile(const vector<double>& values, double p)
+{
+  if (values.empty()) {
+    return 0;
+  }
+
+  size_t index = (size_t) (p * (values.size() - 1) + 0.5);
+  return values[std::min(index, values.size() - 1)];
+}
+
+
+void usage(const char* programName, const Configurator& configurator)
+{
+  cerr << "Usage: " << programName
+       << " [--allocator=NAME] [--num_slaves=N] [--num_frameworks=M] [...]" << endl
+       << endl
+       << "Simulates a cluster of N slaves and M frameworks in order to measure"
+       << endl
+       << "the performance and fairness of an allocator."
+       << endl
+       << endl
+       << "Supported options:" << endl
+       << configurator.getUsage();
+}
+
+
+int main(int argc, char** argv)
+{
+  GOOGLE_PROTOBUF_VERIFY_VERSION;
+
+  Configurator configurator;
+  Master::registerOptions(&configurator);
+
+  configurator.addOption<int>(
+      "num_slaves",
+      "Number of simulated slaves",
+      1000);
+
+  configurator.addOption<int>(
+      "num_frameworks",
+      "Number of simulated frameworks",
+      100);
+
+  configurator.addOption<string>(
+      "slave_resources",
+      "Resources of each slave",
+      "cpus:16;mem:65536");
+
+  configurator.addOption<string>(
+      "task_resources",
+      "Resources of each task; several shapes separated by '|'\n"
+      "get assigned to the frameworks in turn",
+      "cpus:1;mem:1024|cpus:4;mem:2048|cpus:1;mem:8192");
+
+  configurator.addOption<double>(
+      "task_duration",
+      "Average seconds a task runs for (uniformly distributed\n"
+      "between half and one and a half times this)",
+      10.0);
+
+  configurator.addOption<double>(
+      "refusal_rate",
+      "Fraction of offers that frameworks refuse outright",
+      0.1);
+
+  configurator.addOption<double>(
+      "refuse_seconds",
+      "Seconds frameworks filter the slaves of unused offers for",
+      5.0);
+
+  configurator.addOption<int>(
+      "max_tasks",
+      "Maximum running tasks per framework (0 for no maximum)",
+      0);
+
+  configurator.addOption<double>(
+      "duration",
+      "Seconds to run the simulation for (after registration)",
+      30.0);
+
+  configurator.addOption<double>(
+      "sample_interval",
+      "Seconds between samples of the frameworks' dominant shares",
+      1.0);
+
+  configurator.addOption<int>("seed", "Seed for the frameworks", 42);
+
+  if (argc == 2 && string("--help") == argv[1]) {
+    usage(argv[0], configurator);
+    exit(1);
+  }
+
+  Configuration conf;
+  try {
+    conf = configurator.load(argc, argv, true);
+  } catch (ConfigurationException& e) {
+    cerr << "Configuration error: " << e.what() << endl;
+    exit(1);
+  }
+
+  // Logging everything would mostly measure glog.
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  FLAGS_minloglevel = google::WARNING;
+
+  process::initialize(false);
+
+  const string name = conf.get("allocator", "simple");
+  const int numSlaves = conf.get<int>("num_slaves", 1000);
+  const int numFrameworks = conf.get<int>("num_frameworks", 100);
+  const Resources slaveResources =
+    Resources::parse(conf.get("slave_resources", "cpus:16;mem:65536"));
+  const double duration = conf.get<double>("duration", 30.0);
+  const double sampleInterval = conf.get<double>("sample_interval", 1.0);
+  const int seed = conf.get<int>("seed", 42);
+
+  vector<Resources> shapes;
+  foreach (const string& shape,
+           strings::split(conf.get("task_resources", "cpus:1;mem:1024"), "|")) {
+    shapes.push_back(Resources::parse(shape));
+  }
+
+  if (shapes.empty()) {
+    cerr << "Configuration error: no task resources" << endl;
+    exit(1);
+  }
+
+  Allocator* instance = AllocatorFactory::instantiate(name, NULL);
+
+  if (instance == NULL) {
+    cerr << "Unrecognized allocator: " << name << endl;
+    exit(1);
+  }
+
+  TimedAllocator allocator(instance);
+
+  Master* master = new Master(&allocator, conf);
+  PID<Master> pid = process::spawn(master);
+
+  BasicMasterDetector detector(pid);
+
+  Counters counters;
+
+  Timer setup;
+  setup.start();
+
+  vector<SimulatedSlave*> slaves;
+  for (int i = 0; i < numSlaves; i++) {
+    SlaveInfo info;
+    info.set_hostname("slave" + stringify(i));
+    info.set_webui_hostname(info.hostname());
+    info.mutable_resources()->MergeFrom(slaveResources);
+
+    SimulatedSlave* slave =
+      new SimulatedSlave("slave" + stringify(i), pid, info, &counters);
+    process::spawn(slave);
+    slaves.push_back(slave);
+  }
+
+  vector<SimulatedFramework*> frameworks;
+  for (int i = 0; i < numFrameworks; i++) {
+    FrameworkInfo info;
+    info.set_user("nobody");
+    info.set_name("framework" + stringify(i));
+    info.mutable_executor()->mutable_executor_id()->set_value("default");
+    info.mutable_executor()->set_uri("noexecutor");
+
+    SimulatedFramework* framework =
+      new SimulatedFramework("scheduler" + stringify(i), pid, info,
+                             shapes[i % shapes.size()], conf,
+                             seed + i, &counters);
+    process::spawn(framework);
+    frameworks.push_back(framework);
+  }
+
+  while (counters.slavesRegistered < numSlaves ||
+         counters.frameworksRegistered < numFrameworks) {
+    usleep(10000);
+  }
+
+  setup.stop();
+
+  // Measure from here on.
+  const Counters initial = counters;
+
+  allocator.start();
+
+  Timer elapsed;
+  elapsed.start();
+
+  // The (dominant) shares are calculated against all the resources
+  // in the cluster, using the same definition as the DRFAllocator.
+  Resources total;
+  for (int i = 0; i < numSlaves; i++) {
+    total += slaveResources;
+  }
+
+  int samples = 0;
+  double shareMean = 0;
+  double shareVariance = 0;
+  double maxShareVariance = 0;
+
+  while (elapsed.elapsed().secs() < duration) {
+    usleep((useconds_t) (std::min(sampleInterval,
+                                  duration - elapsed.elapsed().secs()) * 1e6));
+
+    vector<Future<Resources> > futures;
+    foreach (SimulatedFramework* framework, frameworks) {
+      futures.push_back(
+          process::dispatch(framework->self(), &SimulatedFramework::used));
+    }
+
+    DRFSorter sorter;
+    sorter.add(total);
+
+    vector<FrameworkID> frameworkIds;
+    for (size_t i = 0; i < futures.size(); i++) {
+      FrameworkID frameworkId;
+      frameworkId.set_value(stringify(i));
+      sorter.add(frameworkId);
+      sorter.allocated(frameworkId, futures[i].get());
+      frameworkIds.push_back(frameworkId);
+    }
+
+    vector<double> shares;
+    foreach (const FrameworkID& frameworkId, frameworkIds) {
+      shares.push_back(sorter.share(frameworkId));
+    }
+
+    double mean = 0;
+    foreach (double share, shares) {
+      mean += share;
+    }
+    mean /= std::max(shares.size(), (size_t) 1);
+
+    double variance = 0;
+    foreach (double share, shares) {
+      variance += (share - mean) * (share - mean);
+    }
+    variance /= std::max(shares.size(), (size_t) 1);
+
+    samples++;
+    shareMean += mean;
+    shareVariance += variance;
+    maxShareVariance = std::max(maxShareVariance, variance);
+  }
+
+  vector<double> latencies = allocator.stop();
+
+  elapsed.stop();
+
+  const double secs = elapsed.elapsed().secs();
+
+  JSON::Object object;
+  object.values["allocator"] = JSON::String(name);
+  object.values["num_slaves"] = numSlaves;
+  object.values["num_frameworks"] = numFrameworks;
+  object.values["task_duration"] = conf.get<double>("task_duration", 10.0);
+  object.values["refusal_rate"] = conf.get<double>("refusal_rate", 0.1);
+  object.values["setup_secs"] = setup.elapsed().secs();
+  object.values["secs"] = secs;
+
+  const long offers = counters.offers - initial.offers;
+  object.values["offers"] = offers;
+  object.values["offers_per_sec"] = offers / secs;
+  object.values["offers_refused"] = counters.refused - initial.refused;
+  object.values["tasks_launched"] = counters.launched - initial.launched;
+  object.values["tasks_finished"] = counters.finished - initial.finished;
+
+  object.values["drf_share_mean"] = shareMean / std::max(samples, 1);
+  object.values["drf_share_variance"] = shareVariance / std::max(samples, 1);
+  object.values["drf_share_max_variance"] = maxShareVariance;
+
+  object.values["rss_kb"] = memory("VmRSS");
+  object.values["peak_rss_kb"] = memory("VmHWM");
+
+  // Include whatever the allocator itself keeps track of.
+  allocator.statistics(&object);
+
+  std::sort(latencies.begin(), latencies.end());
+
+  double sum = 0;
+  foreach (double latency, latencies) {
+    sum += latency;
+  }
+
+  object.values["allocator_calls"] = latencies.size();
+  object.values["allocator_call_mean_secs"] =
+    sum / std::max(latencies.size(), (size_t) 1);
+  object.values["allocator_call_p50_secs"] = percentile(latencies, 0.5);
+  object.values["allocator_call_p90_secs"] = percentile(latencies, 0.9);
+  object.values["allocator_call_p99_secs"] = percentile(latencies, 0.99);
+  object.values["allocator_call_max_secs"] =
+    latencies.empty() ? 0 : latencies.back();
+
+  // For a synchronous allocator the calls are the allocation passes.
+  if (object.values.count("allocation_p50_secs") == 0) {
+    object.values["allocation_p50_secs"] = percentile(latencies, 0.5);
+    object.values["allocation_p90_secs"] = percentile(latencies, 0.9);
+    object.values["allocation_p99_secs"] = percentile(latencies, 0.99);
+  }
+
+  JSON::render(std::cout, object);
+  std::cout << endl;
+
+  // Don't bother shutting the master and the simulated slaves and
+  // frameworks down, which at this scale takes far longer than the
+  // simulation itself (the master removes every framework and slave).
+  _exit(0);
+}
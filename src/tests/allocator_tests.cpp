@@ -0,0 +1,492 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gmock/gmock.h>
+
+#include <mesos/executor.hpp>
+#include <mesos/scheduler.hpp>
+
+#include "common/json.hpp"
+
+#include "configurator/configuration.hpp"
+
+#include "detector/detector.hpp"
+
+#include "local/local.hpp"
+
+#include "master/drf_allocator.hpp"
+#include "master/drf_sorter.hpp"
+#include "master/master.hpp"
+#include "master/offer_filters.hpp"
+
+#include "slave/slave.hpp"
+
+#include "tests/utils.hpp"
+
+using namespace mesos;
+using namespace mesos::internal;
+using namespace mesos::internal::test;
+
+using mesos::internal::master::DRFAllocator;
+using mesos::internal::master::DRFSorter;
+using mesos::internal::master::Master;
+using mesos::internal::master::OfferFilters;
+using mesos::internal::master::Refusers;
+
+using mesos::internal::slave::Slave;
+
+using process::PID;
+
+using std::map;
+using std::string;
+using std::vector;
+
+using testing::_;
+using testing::AtMost;
+using testing::DoAll;
+using testing::Return;
+using testing::SaveArg;
+
+
+static FrameworkID id(const string& value)
+{
+  FrameworkID frameworkId;
+  frameworkId.set_value(value);
+  return frameworkId;
+}
+
+
+static SlaveID slaveId(const string& value)
+{
+  SlaveID slaveId;
+  slaveId.set_value(value);
+  return slaveId;
+}
+
+
+TEST(DRFSorterTest, DominantShares)
+{
+  DRFSorter sorter;
+
+  sorter.add(Resources::parse("cpus:100;mem:100"));
+
+  sorter.add(id("a"));
+  sorter.add(id("b"));
+
+  // Equal shares are ordered by framework ID.
+  vector<FrameworkID> order = sorter.sort();
+  ASSERT_EQ(2, order.size());
+  EXPECT_EQ(id("a"), order[0]);
+  EXPECT_EQ(id("b"), order[1]);
+
+  sorter.allocated(id("a"), Resources::parse("cpus:5;mem:5"));
+
+  order = sorter.sort();
+  EXPECT_EQ(id("b"), order[0]);
+  EXPECT_EQ(id("a"), order[1]);
+
+  // The dominant share of "b" is memory.
+  sorter.allocated(id("b"), Resources::parse("cpus:1;mem:10"));
+
+  EXPECT_EQ(0.05, sorter.share(id("a")));
+  EXPECT_EQ(0.1, sorter.share(id("b")));
+
+  order = sorter.sort();
+  EXPECT_EQ(id("a"), order[0]);
+  EXPECT_EQ(id("b"), order[1]);
+
+  sorter.unallocated(id("b"), Resources::parse("mem:8"));
+
+  EXPECT_EQ(0.02, sorter.share(id("b")));
+
+  order = sorter.sort();
+  EXPECT_EQ(id("b"), order[0]);
+  EXPECT_EQ(id("a"), order[1]);
+
+  sorter.add(id("c"));
+
+  order = sorter.sort();
+  ASSERT_EQ(3, order.size());
+  EXPECT_EQ(id("c"), order[0]);
+
+  sorter.remove(id("c"));
+
+  EXPECT_EQ(2, sorter.size());
+  EXPECT_FALSE(sorter.contains(id("c")));
+}
+
+
+TEST(DRFSorterTest, TotalChanges)
+{
+  DRFSorter sorter;
+
+  sorter.add(id("a"));
+  sorter.add(id("b"));
+
+  sorter.allocated(id("a"), Resources::parse("cpus:4"));
+  sorter.allocated(id("b"), Resources::parse("mem:40"));
+
+  // Without any resources there aren't any shares either.
+  EXPECT_EQ(0, sorter.share(id("a")));
+  EXPECT_EQ(0, sorter.share(id("b")));
+
+  sorter.add(Resources::parse("cpus:8;mem:100"));
+
+  EXPECT_EQ(0.5, sorter.share(id("a")));
+  EXPECT_EQ(0.4, sorter.share(id("b")));
+  EXPECT_EQ(id("b"), sorter.sort()[0]);
+
+  sorter.add(Resources::parse("cpus:8;mem:100"));
+
+  EXPECT_EQ(0.25, sorter.share(id("a")));
+  EXPECT_EQ(0.2, sorter.share(id("b")));
+
+  sorter.remove(Resources::parse("mem:150"));
+
+  EXPECT_EQ(0.8, sorter.share(id("b")));
+  EXPECT_EQ(id("a"), sorter.sort()[0]);
+}
+
+
+TEST(OfferFiltersTest, ResourceShapes)
+{
+  OfferFilters filters;
+
+  filters.add(id("a"), slaveId("s1"), Resources::parse("cpus:2;mem:1024"), 0);
+
+  // Filters apply to the refused resources and anything less.
+  EXPECT_TRUE(filters.filtered(
+      id("a"), slaveId("s1"), Resources::parse("cpus:2;mem:1024")));
+  EXPECT_TRUE(filters.filtered(
+      id("a"), slaveId("s1"), Resources::parse("cpus:1;mem:512")));
+  EXPECT_FALSE(filters.filtered(
+      id("a"), slaveId("s1"), Resources::parse("cpus:4;mem:1024")));
+  EXPECT_FALSE(filters.filtered(
+      id("a"), slaveId("s1"), Resources::parse("cpus:1;mem:1024;disk:10")));
+
+  // But only to that framework on that slave.
+  EXPECT_FALSE(filters.filtered(
+      id("b"), slaveId("s1"), Resources::parse("cpus:1;mem:512")));
+  EXPECT_FALSE(filters.filtered(
+      id("a"), slaveId("s2"), Resources::parse("cpus:1;mem:512")));
+}
+
+
+TEST(OfferFiltersTest, Expiration)
+{
+  OfferFilters filters;
+
+  Resources resources = Resources::parse("cpus:1;mem:512");
+
+  filters.add(id("a"), slaveId("s1"), resources, 10);
+  filters.add(id("a"), slaveId("s2"), resources, 20);
+  filters.add(id("b"), slaveId("s1"), resources, 0); // Forever.
+
+  EXPECT_EQ(3, filters.size());
+
+  EXPECT_EQ(0, filters.expire(5));
+  EXPECT_EQ(1, filters.expire(10));
+  EXPECT_FALSE(filters.filtered(id("a"), slaveId("s1"), resources));
+  EXPECT_TRUE(filters.filtered(id("a"), slaveId("s2"), resources));
+
+  // A filter that replaces another one expires when it says so.
+  filters.add(id("a"), slaveId("s2"), resources, 30);
+
+  EXPECT_EQ(0, filters.expire(25));
+  EXPECT_TRUE(filters.filtered(id("a"), slaveId("s2"), resources));
+
+  EXPECT_EQ(1, filters.expire(30));
+  EXPECT_FALSE(filters.filtered(id("a"), slaveId("s2"), resources));
+
+  EXPECT_EQ(0, filters.expire(1000));
+  EXPECT_EQ(1, filters.size());
+  EXPECT_TRUE(filters.filtered(id("b"), slaveId("s1"), resources));
+}
+
+
+TEST(OfferFiltersTest, Remove)
+{
+  OfferFilters filters;
+
+  Resources resources = Resources::parse("cpus:1;mem:512");
+
+  filters.add(id("a"), slaveId("s1"), resources, 10);
+  filters.add(id("a"), slaveId("s2"), resources, 0);
+  filters.add(id("b"), slaveId("s1"), resources, 0);
+  filters.add(id("b"), slaveId("s2"), resources, 0);
+
+  filters.remove(id("a"));
+
+  EXPECT_EQ(2, filters.size());
+  EXPECT_FALSE(filters.filtered(id("a"), slaveId("s2"), resources));
+
+  // Removed filters don't expire (again).
+  EXPECT_EQ(0, filters.expire(10));
+
+  filters.remove(slaveId("s1"));
+
+  EXPECT_EQ(1, filters.size());
+  EXPECT_FALSE(filters.filtered(id("b"), slaveId("s1"), resources));
+  EXPECT_TRUE(filters.filtered(id("b"), slaveId("s2"), resources));
+
+  filters.remove(id("b"), slaveId("s2"));
+
+  EXPECT_EQ(0, filters.size());
+}
+
+
+TEST(RefusersTest, Remove)
+{
+  Refusers refusers;
+
+  refusers.add(slaveId("s1"), id("a"));
+  refusers.add(slaveId("s1"), id("b"));
+  refusers.add(slaveId("s2"), id("a"));
+
+  EXPECT_EQ(2, refusers.count(slaveId("s1")));
+  EXPECT_TRUE(refusers.contains(slaveId("s2"), id("a")));
+
+  refusers.remove(id("a"));
+
+  EXPECT_EQ(1, refusers.count(slaveId("s1")));
+  EXPECT_EQ(0, refusers.count(slaveId("s2")));
+  EXPECT_TRUE(refusers.contains(slaveId("s1"), id("b")));
+
+  refusers.remove(slaveId("s1"));
+
+  EXPECT_FALSE(refusers.contains(slaveId("s1"), id("b")));
+}
+
+
+TEST(DRFAllocatorTest, ResourceOfferWithMultipleSlaves)
+{
+  ASSERT_TRUE(GTEST_IS_THREADSAFE);
+
+  DRFAllocator allocator;
+
+  PID<Master> master = local::launch(10, 2, 1 * Gigabyte, false, &allocator);
+
+  MockScheduler sched;
+  MesosSchedulerDriver driver(&sched, "", DEFAULT_EXECUTOR_INFO, master);
+
+  vector<Offer> offers;
+
+  trigger resourceOffersCall;
+
+  EXPECT_CALL(sched, registered(&driver, _))
+    .Times(1);
+
+  EXPECT_CALL(sched, resourceOffers(&driver, _))
+    .WillOnce(DoAll(SaveArg<1>(&offers),
+                    Trigger(&resourceOffersCall)))
+    .WillRepeatedly(Return());
+
+  EXPECT_CALL(sched, offerRescinded(&driver, _))
+    .Times(AtMost(1));
+
+  driver.start();
+
+  WAIT_UNTIL(resourceOffersCall);
+
+  EXPECT_NE(0, offers.size());
+  EXPECT_GE(10, offers.size());
+
+  Resources resources(offers[0].resources());
+  EXPECT_EQ(2, resources.get("cpus", Value::Scalar()).value());
+  EXPECT_EQ(1024, resources.get("mem", Value::Scalar()).value());
+
+  driver.stop();
+  driver.join();
+
+  local::shutdown();
+}
+
+
+// Checks that an allocation happens as soon as enough slaves and
+// frameworks have changed, without waiting for a timer tick.
+TEST(DRFAllocatorTest, AllocateWhenBatchIsFull)
+{
+  ASSERT_TRUE(GTEST_IS_THREADSAFE);
+
+  Configuration conf;
+  conf.set("slaves", "*");
+  conf.set("num_slaves", 1);
+  conf.set("resources", "cpus:2;mem:1024");
+  conf.set("allocation_interval", 1000); // No timer ticks in this test.
+  conf.set("allocation_batch_size", 2); // The slave and the framework.
+
+  DRFAllocator allocator;
+
+  PID<Master> master = local::launch(conf, &allocator);
+
+  MockScheduler sched;
+  MesosSchedulerDriver driver(&sched, "", DEFAULT_EXECUTOR_INFO, master);
+
+  vector<Offer> offers;
+
+  trigger resourceOffersCall;
+
+  EXPECT_CALL(sched, registered(&driver, _))
+    .Times(1);
+
+  EXPECT_CALL(sched, resourceOffers(&driver, _))
+    .WillOnce(DoAll(SaveArg<1>(&offers),
+                    Trigger(&resourceOffersCall)))
+    .WillRepeatedly(Return());
+
+  EXPECT_CALL(sched, offerRescinded(&driver, _))
+    .Times(AtMost(1));
+
+  driver.start();
+
+  WAIT_UNTIL(resourceOffersCall);
+
+  EXPECT_EQ(1, offers.size());
+
+  driver.stop();
+  driver.join();
+
+  local::shutdown();
+
+  // Recovering the offer of the stopped framework only dirties the
+  // slave, so there shouldn't have been another pass.
+  JSON::Object object;
+  allocator.statistics(&object);
+
+  JSON::Number passes =
+    boost::get<JSON::Number>(object.values["allocation_passes"]);
+  JSON::Number considered =
+    boost::get<JSON::Number>(object.values["allocation_slaves_considered"]);
+
+  EXPECT_EQ(1, passes.value);
+  EXPECT_EQ(1, considered.value);
+}
+
+
+// Checks that resources a framework doesn't use get offered to the
+// framework with the lowest dominant share.
+TEST(DRFAllocatorTest, UnusedResourcesGoToLowestShare)
+{
+  ASSERT_TRUE(GTEST_IS_THREADSAFE);
+
+  DRFAllocator a;
+  Master m(&a);
+  PID<Master> master = process::spawn(&m);
+
+  MockExecutor exec;
+
+  trigger launchTaskCall, shutdownCall;
+
+  EXPECT_CALL(exec, init(_, _))
+    .Times(1);
+
+  EXPECT_CALL(exec, launchTask(_, _))
+    .WillOnce(Trigger(&launchTaskCall));
+
+  EXPECT_CALL(exec, shutdown(_))
+    .WillOnce(Trigger(&shutdownCall));
+
+  map<ExecutorID, Executor*> execs;
+  execs[DEFAULT_EXECUTOR_ID] = &exec;
+
+  TestingIsolationModule isolationModule(execs);
+
+  Resources resources = Resources::parse("cpus:2;mem:1024");
+
+  Slave s(resources, true, &isolationModule);
+  PID<Slave> slave = process::spawn(&s);
+
+  BasicMasterDetector detector(master, slave, true);
+
+  MockScheduler sched1;
+  MesosSchedulerDriver driver1(&sched1, "", DEFAULT_EXECUTOR_INFO, master);
+
+  vector<Offer> offers1;
+
+  trigger sched1ResourceOffersCall;
+
+  EXPECT_CALL(sched1, registered(&driver1, _))
+    .Times(1);
+
+  EXPECT_CALL(sched1, resourceOffers(&driver1, _))
+    .WillOnce(DoAll(SaveArg<1>(&offers1),
+                    Trigger(&sched1ResourceOffersCall)))
+    .WillRepeatedly(Return());
+
+  driver1.start();
+
+  WAIT_UNTIL(sched1ResourceOffersCall);
+
+  ASSERT_EQ(1, offers1.size());
+
+  MockScheduler sched2;
+  MesosSchedulerDriver driver2(&sched2, "", DEFAULT_EXECUTOR_INFO, master);
+
+  vector<Offer> offers2;
+
+  trigger sched2RegisteredCall, sched2ResourceOffersCall;
+
+  EXPECT_CALL(sched2, registered(&driver2, _))
+    .WillOnce(Trigger(&sched2RegisteredCall));
+
+  EXPECT_CALL(sched2, resourceOffers(&driver2, _))
+    .WillOnce(DoAll(SaveArg<1>(&offers2),
+                    Trigger(&sched2ResourceOffersCall)))
+    .WillRepeatedly(Return());
+
+  driver2.start();
+
+  WAIT_UNTIL(sched2RegisteredCall);
+
+  // Use half of the slave, the other half goes to the second
+  // framework (which has nothing yet).
+  TaskDescription task;
+  task.set_name("");
+  task.mutable_task_id()->set_value("1");
+  task.mutable_slave_id()->MergeFrom(offers1[0].slave_id());
+  task.mutable_resources()->MergeFrom(Resources::parse("cpus:1;mem:512"));
+
+  vector<TaskDescription> tasks;
+  tasks.push_back(task);
+
+  driver1.launchTasks(offers1[0].id(), tasks);
+
+  WAIT_UNTIL(launchTaskCall);
+
+  WAIT_UNTIL(sched2ResourceOffersCall);
+
+  ASSERT_EQ(1, offers2.size());
+
+  Resources offered(offers2[0].resources());
+  EXPECT_EQ(1, offered.get("cpus", Value::Scalar()).value());
+  EXPECT_EQ(512, offered.get("mem", Value::Scalar()).value());
+
+  driver2.stop();
+  driver2.join();
+
+  driver1.stop();
+  driver1.join();
+
+  WAIT_UNTIL(shutdownCall); // To ensure can deallocate MockExecutor.
+
+  process::terminate(slave);
+  process::wait(slave);
+
+  process::terminate(master);
+  process::wait(master);
+}
@@ -31,6 +31,7 @@
 
 #include <process/process.hpp>
 
+#include "common/option.hpp"
 #include "common/utils.hpp"
 #include "common/type_utils.hpp"
 
@@ -139,16 +140,17 @@ public:
 class MockAllocator : public master::Allocator
 {
 public:
-  MOCK_METHOD1(initialize, void(master::Master*));
+  MOCK_METHOD2(initialize, void(master::Master*, const Configuration&));
   MOCK_METHOD1(frameworkAdded, void(master::Framework*));
   MOCK_METHOD1(frameworkRemoved, void(master::Framework*));
   MOCK_METHOD1(slaveAdded, void(master::Slave*));
   MOCK_METHOD1(slaveRemoved, void(master::Slave*));
   MOCK_METHOD2(resourcesRequested, void(const FrameworkID&,
                                         const std::vector<ResourceRequest>&));
-  MOCK_METHOD3(resourcesUnused, void(const FrameworkID&,
+  MOCK_METHOD4(resourcesUnused, void(const FrameworkID&,
                                      const SlaveID&,
-                                     const Resources&));
+                                     const Resources&,
+                                     const Option<double>&));
   MOCK_METHOD3(resourcesRecovered, void(const FrameworkID&,
                                         const SlaveID&,
                                         const Resources&));
@@ -0,0 +1,187 @@
+#ifndef __PROCESS_BUFFER_HPP__
+#define __PROCESS_BUFFER_HPP__
+
+#include <stdlib.h> // For NULL.
+
+#include <string>
+
+namespace process {
+
+// An immutable, reference counted sequence of bytes (e.g., the body
+// of a message). Copying a buffer only increments the reference
+// count, so a body can be passed from the sender, through the
+// mailbox of a local receiver or the encoder of a socket, without
+// ever being copied. A buffer converts to a 'const std::string&' so
+// that it can be handed to anything expecting a string (e.g., message
+// handlers) without a copy either.
+//
+// A buffer can also hold an object that the bytes get serialized
+// from, which only happens if and when somebody asks for the bytes.
+// This lets a receiver in the same operating system process use the
+// object directly (see ProtobufProcess).
+class Buffer
+{
+public:
+  // An object held by a buffer in place of its bytes.
+  class Object
+  {
+  public:
+    virtual ~Object() {}
+    virtual void serialize(std::string* data) const = 0;
+  };
+
+  Buffer() : rep(NULL) {}
+
+  // Note that these copy the data (see 'take' for avoiding that). An
+  // empty buffer doesn't allocate anything.
+  Buffer(const std::string& data)
+    : rep(data.empty() ? NULL : new Rep(data)) {}
+
+  Buffer(const char* data)
+    : rep(data == NULL || *data == '\0' ? NULL : new Rep(data)) {}
+
+  Buffer(const char* data, size_t length)
+    : rep(length == 0 ? NULL : new Rep(std::string(data, length))) {}
+
+  Buffer(const Buffer& that) : rep(that.rep)
+  {
+    if (rep != NULL) {
+      __sync_fetch_and_add(&rep->refs, 1);
+    }
+  }
+
+  ~Buffer()
+  {
+    release();
+  }
+
+  Buffer& operator = (const Buffer& that)
+  {
+    if (rep != that.rep) {
+      if (that.rep != NULL) {
+        __sync_fetch_and_add(&that.rep->refs, 1);
+      }
+      release();
+      rep = that.rep;
+    }
+    return *this;
+  }
+
+  // Returns a buffer with the contents of 'data', leaving 'data'
+  // empty. This doesn't copy the data (it swaps it into the buffer).
+  static Buffer take(std::string* data)
+  {
+    Buffer buffer;
+    if (!data->empty()) {
+      buffer.rep = new Rep();
+      buffer.rep->data.swap(*data);
+    }
+    return buffer;
+  }
+
+  // Returns a buffer holding 'object' (the buffer takes ownership),
+  // which gets serialized the first time the bytes are needed.
+  static Buffer wrap(Object* object)
+  {
+    Buffer buffer;
+    buffer.rep = new Rep();
+    buffer.rep->object = object;
+    buffer.rep->serialized = false;
+    return buffer;
+  }
+
+  // Returns the object held by this buffer, if any.
+  const Object* object() const
+  {
+    return rep != NULL ? rep->object : NULL;
+  }
+
+  const std::string& str() const
+  {
+    if (rep == NULL) {
+      return none();
+    }
+
+    if (!rep->serialized) {
+      serialize();
+    }
+
+    return rep->data;
+  }
+
+  operator const std::string& () const
+  {
+    return str();
+  }
+
+  const char* data() const { return str().data(); }
+
+  size_t size() const { return str().size(); }
+
+  bool empty() const { return size() == 0; }
+
+  bool operator == (const Buffer& that) const
+  {
+    return rep == that.rep || str() == that.str();
+  }
+
+  bool operator != (const Buffer& that) const
+  {
+    return !(*this == that);
+  }
+
+private:
+  struct Rep
+  {
+    Rep() : refs(1), object(NULL), serialized(true), lock(0) {}
+
+    explicit Rep(const std::string& _data)
+      : refs(1), data(_data), object(NULL), serialized(true), lock(0) {}
+
+    ~Rep()
+    {
+      delete object;
+    }
+
+    int refs;
+    std::string data; // Never modified once serialized.
+    Object* object;
+    volatile bool serialized;
+    int lock;
+  };
+
+  static const std::string& none()
+  {
+    static const std::string* string = new std::string();
+    return *string;
+  }
+
+  // Serializes the object (once) even if multiple threads ask for the
+  // bytes at the same time.
+  void serialize() const
+  {
+    while (__sync_lock_test_and_set(&rep->lock, 1) != 0);
+
+    if (!rep->serialized) {
+      rep->object->serialize(&rep->data);
+      __sync_synchronize();
+      rep->serialized = true;
+    }
+
+    __sync_lock_release(&rep->lock);
+  }
+
+  void release()
+  {
+    if (rep != NULL && __sync_sub_and_fetch(&rep->refs, 1) == 0) {
+      delete rep;
+    }
+    rep = NULL;
+  }
+
+  Rep* rep;
+};
+
+} // namespace process {
+
+#endif // __PROCESS_BUFFER_HPP__
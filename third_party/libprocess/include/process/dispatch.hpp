@@ -30,10 +30,10 @@ namespace process {
 // those definitions.
 //
 // Dispatching is done via a level of indirection. The dispatch
-// routine itself creates a promise that is passed as an argument to a
-// partially applied 'dispatcher' function (defined below). The
-// dispatcher routines get passed to the actual process via an
-// internal routine called, not suprisingly, 'dispatch', defined
+// routine itself binds the method and its arguments and creates a
+// dispatch event (defined below) that stores that call, along with
+// the promise for its result (if any). The event gets passed to the
+// actual process via an internal routine called 'deliver', defined
 // below:
 
 namespace internal {
@@ -49,8 +49,15 @@ namespace internal {
 void dispatch(const UPID& pid, std::tr1::function<void(ProcessBase*)>* f);
 
 
-// The magic of dispatch actually occurs within the dispatcher
-// routines. In particular, some of the dispatcher routines need to
+// Like above but for an event that stores the call itself (see
+// below), the event gets deleted if the process is no longer valid.
+// Not an overload of 'dispatch' so that 'dispatch' can still be bound
+// without disambiguating it (e.g., see timer.hpp).
+void deliver(const UPID& pid, DispatchEvent* event);
+
+
+// The magic of dispatch actually occurs within the dispatch
+// events. In particular, some of the dispatch events need to
 // wait for values and "associate" them with the future that got
 // returned from the original call to dispatch. Those association
 // functions are defined here:
@@ -82,10 +89,10 @@ void associate(const Future<T>& from, std::tr1::shared_ptr<Promise<T> > to)
 }
 
 
-// Finally come the dispatcher functions (one for each return type:
-// void, future, value) which should complete the picture. Given the
-// process argument these routines downcast the process to the correct
-// subtype and invoke the thunk using the subtype as the argument
+// The 'vdispatcher' routine is used for functions that get passed
+// around before they are dispatched (e.g., see timer.hpp). Given the
+// process argument it downcasts the process to the correct subtype
+// and invokes the thunk using the subtype as the argument
 // (receiver). Note that we must use dynamic_cast because we permit a
 // process to use multiple inheritance (e.g., to expose multiple
 // callback interfaces).
@@ -102,29 +109,100 @@ void vdispatcher(
 }
 
 
-template <typename R, typename T>
-void pdispatcher(
-    ProcessBase* process,
-    std::tr1::shared_ptr<std::tr1::function<Future<R>(T*)> > thunk,
-    std::tr1::shared_ptr<Promise<R> > promise)
+// Finally come the dispatch events (one for each return type: void,
+// future, value) which should complete the picture. Each event stores
+// the bound method call (and the promise for its result) inline, so
+// that dispatching only costs allocating the event (and the future,
+// if there is one) rather than also allocating functions, thunks and
+// shared pointers that wrap the call. The bound call is 'mutable'
+// since events get applied via a const reference (just like a
+// function would invoke it). Like above, the process gets downcast
+// to the correct subtype before invoking the call.
+
+template <typename T, typename F>
+struct VoidDispatchEvent : DispatchEvent
 {
-  assert(process != NULL);
-  T* t = dynamic_cast<T*>(process);
-  assert(t != NULL);
-  associate((*thunk)(t), promise);
+  explicit VoidDispatchEvent(const F& _f) : f(_f) {}
+
+  virtual void apply(ProcessBase* process) const
+  {
+    assert(process != NULL);
+    T* t = dynamic_cast<T*>(process);
+    assert(t != NULL);
+    f(t);
+  }
+
+  mutable F f;
+};
+
+
+template <typename R, typename T, typename F>
+struct FutureDispatchEvent : DispatchEvent
+{
+  explicit FutureDispatchEvent(const F& _f)
+    : f(_f), promise(new Promise<R>()) {}
+
+  virtual void apply(ProcessBase* process) const
+  {
+    assert(process != NULL);
+    T* t = dynamic_cast<T*>(process);
+    assert(t != NULL);
+    associate(f(t), promise);
+  }
+
+  mutable F f;
+
+  // Shared since the promise needs to outlive the event if the
+  // future returned by the method isn't ready yet.
+  const std::tr1::shared_ptr<Promise<R> > promise;
+};
+
+
+template <typename R, typename T, typename F>
+struct ValueDispatchEvent : DispatchEvent
+{
+  explicit ValueDispatchEvent(const F& _f) : f(_f) {}
+
+  virtual void apply(ProcessBase* process) const
+  {
+    assert(process != NULL);
+    T* t = dynamic_cast<T*>(process);
+    assert(t != NULL);
+    promise.set(f(t));
+  }
+
+  mutable F f;
+  mutable Promise<R> promise;
+};
+
+
+// Helpers for creating (and dispatching) the events above, which
+// deduce the type of the bound call.
+
+template <typename T, typename F>
+void vdispatch(const UPID& pid, const F& f)
+{
+  deliver(pid, new VoidDispatchEvent<T, F>(f));
 }
 
 
-template <typename R, typename T>
-void rdispatcher(
-    ProcessBase* process,
-    std::tr1::shared_ptr<std::tr1::function<R(T*)> > thunk,
-    std::tr1::shared_ptr<Promise<R> > promise)
+template <typename R, typename T, typename F>
+Future<R> pdispatch(const UPID& pid, const F& f)
 {
-  assert(process != NULL);
-  T* t = dynamic_cast<T*>(process);
-  assert(t != NULL);
-  promise->set((*thunk)(t));
+  FutureDispatchEvent<R, T, F>* event = new FutureDispatchEvent<R, T, F>(f);
+  Future<R> future = event->promise->future();
+  deliver(pid, event);
+  return future;
+}
+
+
+template <typename R, typename T, typename F>
+Future<R> rdispatch(const UPID& pid, const F& f)
+{
+  ValueDispatchEvent<R, T, F>* event = new ValueDispatchEvent<R, T, F>(f);
+  Future<R> future = event->promise.future();
+  deliver(pid, event);
+  return future;
 }
 
 } // namespace internal {
@@ -144,19 +222,11 @@ void rdispatcher(
 //     void (T::*method)(P...),
 //     P... p)
 // {
-//   std::tr1::shared_ptr<std::tr1::function<void(T*)> > thunk(
-//       new std::tr1::function<void(T*)>(
-//           std::tr1::bind(method,
-//                          std::tr1::placeholders::_1,
-//                          std::forward<P>(p)...)));
-//
-//   std::tr1::function<void(ProcessBase*)>* dispatcher =
-//     new std::tr1::function<void(ProcessBase*)>(
-//         std::tr1::bind(&internal::vdispatcher<T>,
-//                        std::tr1::placeholders::_1,
-//                        thunk));
-//
-//   internal::dispatch(pid, dispatcher);
+//   internal::vdispatch<T>(
+//       pid,
+//       std::tr1::bind(method,
+//                      std::tr1::placeholders::_1,
+//                      std::forward<P>(p)...));
 // }
 
 template <typename T>
@@ -164,17 +234,9 @@ void dispatch(
     const PID<T>& pid,
     void (T::*method)(void))
 {
-  std::tr1::shared_ptr<std::tr1::function<void(T*)> > thunk(
-      new std::tr1::function<void(T*)>(
-          std::tr1::bind(method, std::tr1::placeholders::_1)));
-
-  std::tr1::function<void(ProcessBase*)>* dispatcher =
-    new std::tr1::function<void(ProcessBase*)>(
-        std::tr1::bind(&internal::vdispatcher<T>,
-                       std::tr1::placeholders::_1,
-                       thunk));
-
-  internal::dispatch(pid, dispatcher);
+  internal::vdispatch<T>(
+      pid,
+      std::tr1::bind(method, std::tr1::placeholders::_1));
 }
 
 template <typename T>
@@ -202,19 +264,11 @@ void dispatch(
       void (T::*method)(ENUM_PARAMS(N, P)),                             \
       ENUM_BINARY_PARAMS(N, A, a))                                      \
   {                                                                     \
-    std::tr1::shared_ptr<std::tr1::function<void(T*)> > thunk(          \
-        new std::tr1::function<void(T*)>(                               \
-            std::tr1::bind(method,                                      \
-                           std::tr1::placeholders::_1,                  \
-                           ENUM_PARAMS(N, a))));                        \
-                                                                        \
-    std::tr1::function<void(ProcessBase*)>* dispatcher =                \
-      new std::tr1::function<void(ProcessBase*)>(                       \
-          std::tr1::bind(&internal::vdispatcher<T>,                     \
-                         std::tr1::placeholders::_1,                    \
-                         thunk));                                       \
-                                                                        \
-    internal::dispatch(pid, dispatcher);                                \
+    internal::vdispatch<T>(                                             \
+        pid,                                                            \
+        std::tr1::bind(method,                                          \
+                       std::tr1::placeholders::_1,                      \
+                       ENUM_PARAMS(N, a)));                             \
   }                                                                     \
                                                                         \
   template <typename T,                                                 \
@@ -251,24 +305,11 @@ void dispatch(
 //     Future<R> (T::*method)(P...),
 //     P... p)
 // {
-//   std::tr1::shared_ptr<std::tr1::function<Future<R>(T*)> > thunk(
-//       new std::tr1::function<Future<R>(T*)>(
-//           std::tr1::bind(method,
-//                          std::tr1::placeholders::_1,
-//                          std::forward<P>(p)...)));
-//
-//   std::tr1::shared_ptr<Promise<R> > promise(new Promise<R>());
-//   Future<R> future = promise->future();
-//
-//   std::tr1::function<void(ProcessBase*)>* dispatcher =
-//     new std::tr1::function<void(ProcessBase*)>(
-//         std::tr1::bind(&internal::pdispatcher<R, T>,
-//                        std::tr1::placeholders::_1,
-//                        thunk, promise));
-//
-//   internal::dispatch(pid, dispatcher);
-//
-//   return future;
+//   return internal::pdispatch<R, T>(
+//       pid,
+//       std::tr1::bind(method,
+//                      std::tr1::placeholders::_1,
+//                      std::forward<P>(p)...));
 // }
 
 template <typename R, typename T>
@@ -276,22 +317,9 @@ Future<R> dispatch(
     const PID<T>& pid,
     Future<R> (T::*method)(void))
 {
-  std::tr1::shared_ptr<std::tr1::function<Future<R>(T*)> > thunk(
-      new std::tr1::function<Future<R>(T*)>(
-          std::tr1::bind(method, std::tr1::placeholders::_1)));
-
-  std::tr1::shared_ptr<Promise<R> > promise(new Promise<R>());
-  Future<R> future = promise->future();
-
-  std::tr1::function<void(ProcessBase*)>* dispatcher =
-    new std::tr1::function<void(ProcessBase*)>(
-        std::tr1::bind(&internal::pdispatcher<R, T>,
-                       std::tr1::placeholders::_1,
-                       thunk, promise));
-
-  internal::dispatch(pid, dispatcher);
-
-  return future;
+  return internal::pdispatch<R, T>(
+      pid,
+      std::tr1::bind(method, std::tr1::placeholders::_1));
 }
 
 template <typename R, typename T>
@@ -320,24 +348,11 @@ Future<R> dispatch(
       Future<R> (T::*method)(ENUM_PARAMS(N, P)),                        \
       ENUM_BINARY_PARAMS(N, A, a))                                      \
   {                                                                     \
-    std::tr1::shared_ptr<std::tr1::function<Future<R>(T*)> > thunk(     \
-        new std::tr1::function<Future<R>(T*)>(                          \
-            std::tr1::bind(method,                                      \
-                           std::tr1::placeholders::_1,                  \
-                           ENUM_PARAMS(N, a))));                        \
-                                                                        \
-    std::tr1::shared_ptr<Promise<R> > promise(new Promise<R>());        \
-    Future<R> future = promise->future();                               \
-                                                                        \
-    std::tr1::function<void(ProcessBase*)>* dispatcher =                \
-      new std::tr1::function<void(ProcessBase*)>(                       \
-          std::tr1::bind(&internal::pdispatcher<R, T>,                  \
-                         std::tr1::placeholders::_1,                    \
-                         thunk, promise));                              \
-                                                                        \
-    internal::dispatch(pid, dispatcher);                                \
-                                                                        \
-    return future;                                                      \
+    return internal::pdispatch<R, T>(                                   \
+        pid,                                                            \
+        std::tr1::bind(method,                                          \
+                       std::tr1::placeholders::_1,                      \
+                       ENUM_PARAMS(N, a)));                             \
   }                                                                     \
                                                                         \
   template <typename R,                                                 \
@@ -376,24 +391,11 @@ Future<R> dispatch(
 //     R (T::*method)(P...),
 //     P... p)
 // {
-//   std::tr1::shared_ptr<std::tr1::function<R(T*)> > thunk(
-//       new std::tr1::function<R(T*)>(
-//           std::tr1::bind(method,
-//                          std::tr1::placeholders::_1,
-//                          std::forward<P>(p)...)));
-//
-//   std::tr1::shared_ptr<Promise<R> > promise(new Promise<R>());
-//   Future<R> future = promise->future();
-//
-//   std::tr1::function<void(ProcessBase*)>* dispatcher =
-//     new std::tr1::function<void(ProcessBase*)>(
-//         std::tr1::bind(&internal::rdispatcher<R, T>,
-//                        std::tr1::placeholders::_1,
-//                        thunk, promise));
-//
-//   internal::dispatch(pid, dispatcher);
-//
-//   return future;
+//   return internal::rdispatch<R, T>(
+//       pid,
+//       std::tr1::bind(method,
+//                      std::tr1::placeholders::_1,
+//                      std::forward<P>(p)...));
 // }
 
 template <typename R, typename T>
@@ -401,22 +403,9 @@ Future<R> dispatch(
     const PID<T>& pid,
     R (T::*method)(void))
 {
-  std::tr1::shared_ptr<std::tr1::function<R(T*)> > thunk(
-      new std::tr1::function<R(T*)>(
-          std::tr1::bind(method, std::tr1::placeholders::_1)));
-
-  std::tr1::shared_ptr<Promise<R> > promise(new Promise<R>());
-  Future<R> future = promise->future();
-
-  std::tr1::function<void(ProcessBase*)>* dispatcher =
-    new std::tr1::function<void(ProcessBase*)>(
-        std::tr1::bind(&internal::rdispatcher<R, T>,
-                       std::tr1::placeholders::_1,
-                       thunk, promise));
-
-  internal::dispatch(pid, dispatcher);
-
-  return future;
+  return internal::rdispatch<R, T>(
+      pid,
+      std::tr1::bind(method, std::tr1::placeholders::_1));
 }
 
 template <typename R, typename T>
@@ -445,24 +434,11 @@ Future<R> dispatch(
       R (T::*method)(ENUM_PARAMS(N, P)),                                \
       ENUM_BINARY_PARAMS(N, A, a))                                      \
   {                                                                     \
-    std::tr1::shared_ptr<std::tr1::function<R(T*)> > thunk(             \
-        new std::tr1::function<R(T*)>(                                  \
-            std::tr1::bind(method,                                      \
-                           std::tr1::placeholders::_1,                  \
-                           ENUM_PARAMS(N, a))));                        \
-                                                                        \
-    std::tr1::shared_ptr<Promise<R> > promise(new Promise<R>());        \
-    Future<R> future = promise->future();                               \
-                                                                        \
-    std::tr1::function<void(ProcessBase*)>* dispatcher =                \
-      new std::tr1::function<void(ProcessBase*)>(                       \
-          std::tr1::bind(&internal::rdispatcher<R, T>,                  \
-                         std::tr1::placeholders::_1,                    \
-                         thunk, promise));                              \
-                                                                        \
-    internal::dispatch(pid, dispatcher);                                \
-                                                                        \
-    return future;                                                      \
+    return internal::rdispatch<R, T>(                                   \
+        pid,                                                            \
+        std::tr1::bind(method,                                          \
+                       std::tr1::placeholders::_1,                      \
+                       ENUM_PARAMS(N, a)));                             \
   }                                                                     \
                                                                         \
   template <typename R,                                                 \
@@ -0,0 +1,54 @@
+#ifndef __PROCESS_DNS_HPP__
+#define __PROCESS_DNS_HPP__
+
+#include <stdint.h>
+
+#include <string>
+
+#include <process/future.hpp>
+#include <process/option.hpp>
+
+namespace process {
+namespace dns {
+
+/**
+ * Resolves a hostname (or a dotted quad, which never needs a lookup)
+ * to an IPv4 address (in network byte order). Addresses are cached
+ * for LIBPROCESS_DNS_TTL seconds (default 60, 0 disables caching),
+ * so only the first call for a hostname (after the entry expired)
+ * blocks on a lookup. Parsing a UPID uses this.
+ *
+ * @param hostname hostname or dotted quad to resolve.
+ * @return the address or none if the hostname can not be resolved.
+ */
+Option<uint32_t> resolve(const std::string& hostname);
+
+
+/**
+ * Like resolve but never blocks the caller. A hostname that is not
+ * cached gets looked up by a separate process (__dns__) and the
+ * future gets set once it is, or failed if it can't be resolved.
+ *
+ * @param hostname hostname or dotted quad to resolve.
+ * @return future of the address.
+ */
+Future<uint32_t> lookup(const std::string& hostname);
+
+
+// Counters for the hostname cache (also available at
+// /__statistics__/dns.json). Dotted quads are not counted.
+struct Statistics
+{
+  uint64_t hits;     // Resolved from the cache.
+  uint64_t misses;   // Not cached (or expired), looked up.
+  uint64_t failures; // Looked up but could not be resolved.
+  uint64_t entries;  // Currently cached hostnames.
+};
+
+
+Statistics statistics();
+
+} // namespace dns {
+} // namespace process {
+
+#endif // __PROCESS_DNS_HPP__
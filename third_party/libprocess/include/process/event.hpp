@@ -10,6 +10,7 @@
 namespace process {
 
 // Forward declarations.
+class Mailbox;
 struct ProcessBase;
 struct MessageEvent;
 struct DispatchEvent;
@@ -30,6 +31,10 @@ struct EventVisitor
 
 struct Event
 {
+  Event() : next(NULL), time(0) {}
+
+  virtual ~Event() {}
+
   virtual void visit(EventVisitor* visitor) const = 0;
 
   template <typename T>
@@ -63,6 +68,15 @@ struct Event
     }
     return *result;
   }
+
+private:
+  friend class Mailbox;
+
+  // Link to the next event when queued in a mailbox.
+  Event* next;
+
+  // When the event was queued in a mailbox (see Mailbox::now).
+  double time;
 };
 
 
@@ -120,7 +134,7 @@ struct DispatchEvent : Event
   DispatchEvent(std::tr1::function<void(ProcessBase*)>* _function)
     : function(_function) {}
 
-  ~DispatchEvent()
+  virtual ~DispatchEvent()
   {
     delete function;
   }
@@ -130,8 +144,19 @@ struct DispatchEvent : Event
     visitor->visit(*this);
   }
 
+  // Applies the dispatched function to the process. Subclasses can
+  // store the call inline instead of in 'function' (which is then
+  // NULL), see dispatch.hpp.
+  virtual void apply(ProcessBase* process) const
+  {
+    (*function)(process);
+  }
+
   std::tr1::function<void(ProcessBase*)>* const function;
 
+protected:
+  DispatchEvent() : function(NULL) {}
+
 private:
   // Not copyable, not assignable.
   DispatchEvent(const DispatchEvent&);
@@ -2,15 +2,20 @@
 #define __PROCESS_FUTURE_HPP__
 
 #include <assert.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdlib.h> // For abort.
 
-#include <queue>
+#include <sys/time.h>
+
+#include <new>
 #include <set>
+#include <string>
+#include <vector>
 
 #include <tr1/functional>
 #include <tr1/memory> // TODO(benh): Replace shared_ptr with unique_ptr.
 
-#include <process/latch.hpp>
 #include <process/option.hpp>
 
 namespace process {
@@ -91,6 +96,10 @@ private:
   void copy(const Future<T>& that);
   void cleanup();
 
+  // Wakes up any threads waiting in 'await' (after the future left
+  // the PENDING state).
+  void wakeup();
+
   enum State {
     PENDING,
     READY,
@@ -98,16 +107,58 @@ private:
     DISCARDED,
   };
 
-  int* refs;
-  int* lock;
-  State* state;
-  T** t;
-  std::string** message; // Message associated with failure.
-  std::queue<ReadyCallback>* onReadyCallbacks;
-  std::queue<FailedCallback>* onFailedCallbacks;
-  std::queue<DiscardedCallback>* onDiscardedCallbacks;
-  std::queue<AnyCallback>* onAnyCallbacks;
-  Latch* latch;
+  // All of the state shared by the copies of a future, allocated once
+  // per future (see below).
+  struct Data;
+
+  Data* data;
+};
+
+
+// The value is constructed in place (rather than allocated when the
+// future gets set) and the callbacks are kept in vectors, which don't
+// allocate anything until a callback actually gets added. Threads
+// that want to block until the future is no longer pending wait on a
+// condition variable, which is only ever signaled if somebody is
+// actually waiting.
+template <typename T>
+struct Future<T>::Data
+{
+  Data()
+    : refs(1), lock(0), state(PENDING), t(NULL), message(NULL), waiters(0)
+  {
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&cond, NULL);
+  }
+
+  ~Data()
+  {
+    if (t != NULL) {
+      t->~T();
+    }
+    delete message;
+    pthread_mutex_destroy(&mutex);
+    pthread_cond_destroy(&cond);
+  }
+
+  int refs;
+  int lock;
+  volatile State state;
+  T* t; // Points into 'storage' once set.
+  std::string* message; // Message associated with failure.
+  std::vector<ReadyCallback> onReadyCallbacks;
+  std::vector<FailedCallback> onFailedCallbacks;
+  std::vector<DiscardedCallback> onDiscardedCallbacks;
+  std::vector<AnyCallback> onAnyCallbacks;
+  int waiters; // Threads blocked in 'await'.
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  char storage[sizeof(T)] __attribute__((aligned));
+
+private:
+  // Not copyable, not assignable.
+  Data(const Data&);
+  Data& operator = (const Data&);
 };
 
 
@@ -180,10 +231,19 @@ Future<T> Promise<T>::future() const
 // Internal helper utilities.
 namespace internal {
 
+// The lock protecting a future is only ever held for a few
+// instructions, so contenders spin for a while before they start
+// yielding the cpu (in case the holder got preempted, for example
+// when there are more threads than cpus).
 inline void acquire(int* lock)
 {
+  int spins = 0;
   while (!__sync_bool_compare_and_swap(lock, 0, 1)) {
-    asm volatile ("pause");
+    if (++spins < 128) {
+      asm volatile ("pause");
+    } else {
+      sched_yield();
+    }
   }
 }
 
@@ -251,30 +311,12 @@ void discard(const std::set<Future<T> >& futures)
 
 template <typename T>
 Future<T>::Future()
-  : refs(new int(1)),
-    lock(new int(0)),
-    state(new State(PENDING)),
-    t(new T*(NULL)),
-    message(new std::string*(NULL)),
-    onReadyCallbacks(new std::queue<ReadyCallback>()),
-    onFailedCallbacks(new std::queue<FailedCallback>()),
-    onDiscardedCallbacks(new std::queue<DiscardedCallback>()),
-    onAnyCallbacks(new std::queue<AnyCallback>()),
-    latch(new Latch()) {}
+  : data(new Data()) {}
 
 
 template <typename T>
 Future<T>::Future(const T& _t)
-  : refs(new int(1)),
-    lock(new int(0)),
-    state(new State(PENDING)),
-    t(new T*(NULL)),
-    message(new std::string*(NULL)),
-    onReadyCallbacks(new std::queue<ReadyCallback>()),
-    onFailedCallbacks(new std::queue<FailedCallback>()),
-    onDiscardedCallbacks(new std::queue<DiscardedCallback>()),
-    onAnyCallbacks(new std::queue<AnyCallback>()),
-    latch(new Latch())
+  : data(new Data())
 {
   set(_t);
 }
@@ -308,18 +350,18 @@ Future<T>& Future<T>::operator = (const Future<T>& that)
 template <typename T>
 bool Future<T>::operator == (const Future<T>& that) const
 {
-  assert(latch != NULL);
-  assert(that.latch != NULL);
-  return *latch == *that.latch;
+  assert(data != NULL);
+  assert(that.data != NULL);
+  return data == that.data;
 }
 
 
 template <typename T>
 bool Future<T>::operator < (const Future<T>& that) const
 {
-  assert(latch != NULL);
-  assert(that.latch != NULL);
-  return *latch < *that.latch;
+  assert(data != NULL);
+  assert(that.data != NULL);
+  return data < that.data;
 }
 
 
@@ -328,33 +370,33 @@ bool Future<T>::discard()
 {
   bool result = false;
 
-  assert(lock != NULL);
-  internal::acquire(lock);
+  assert(data != NULL);
+  internal::acquire(&data->lock);
   {
-    assert(state != NULL);
-    if (*state == PENDING) {
-      *state = DISCARDED;
-      latch->trigger();
+    if (data->state == PENDING) {
+      data->state = DISCARDED;
       result = true;
     }
   }
-  internal::release(lock);
+  internal::release(&data->lock);
 
   // Invoke all callbacks associated with this future being
   // DISCARDED. We don't need a lock because the state is now in
   // DISCARDED so there should not be any concurrent modications.
   if (result) {
-    while (!onDiscardedCallbacks->empty()) {
+    wakeup();
+
+    for (size_t i = 0; i < data->onDiscardedCallbacks.size(); i++) {
       // TODO(*): Invoke callbacks in another execution context.
-      onDiscardedCallbacks->front()();
-      onDiscardedCallbacks->pop();
+      data->onDiscardedCallbacks[i]();
     }
+    data->onDiscardedCallbacks.clear();
 
-    while (!onAnyCallbacks->empty()) {
+    for (size_t i = 0; i < data->onAnyCallbacks.size(); i++) {
       // TODO(*): Invoke callbacks in another execution context.
-      onAnyCallbacks->front()(*this);
-      onAnyCallbacks->pop();
+      data->onAnyCallbacks[i](*this);
     }
+    data->onAnyCallbacks.clear();
   }
 
   return result;
@@ -364,43 +406,80 @@ bool Future<T>::discard()
 template <typename T>
 bool Future<T>::isPending() const
 {
-  assert(state != NULL);
-  return *state == PENDING;
+  assert(data != NULL);
+  return data->state == PENDING;
 }
 
 
 template <typename T>
 bool Future<T>::isReady() const
 {
-  assert(state != NULL);
-  return *state == READY;
+  assert(data != NULL);
+  return data->state == READY;
 }
 
 
 template <typename T>
 bool Future<T>::isDiscarded() const
 {
-  assert(state != NULL);
-  return *state == DISCARDED;
+  assert(data != NULL);
+  return data->state == DISCARDED;
 }
 
 
 template <typename T>
 bool Future<T>::isFailed() const
 {
-  assert(state != NULL);
-  return *state == FAILED;
+  assert(data != NULL);
+  return data->state == FAILED;
 }
 
 
 template <typename T>
 bool Future<T>::await(double secs) const
 {
-  if (!isReady() && !isDiscarded() && !isFailed()) {
-    assert(latch != NULL);
-    return latch->await(secs);
+  assert(data != NULL);
+
+  if (data->state != PENDING) {
+    return true;
   }
-  return true;
+
+  timespec deadline;
+
+  if (secs > 0) {
+    timeval now;
+    gettimeofday(&now, NULL);
+    double until = now.tv_sec + now.tv_usec / 1000000.0 + secs;
+    deadline.tv_sec = (time_t) until;
+    deadline.tv_nsec = (long) ((until - deadline.tv_sec) * 1000000000);
+  }
+
+  pthread_mutex_lock(&data->mutex);
+
+  // Announce ourselves before checking the state again so that
+  // whoever changes the state either sees us (and signals) or we see
+  // the new state (see 'wakeup').
+  __sync_fetch_and_add(&data->waiters, 1);
+
+  bool waited = true;
+
+  while (data->state == PENDING) {
+    if (secs > 0) {
+      if (pthread_cond_timedwait(&data->cond, &data->mutex, &deadline) != 0 &&
+          data->state == PENDING) {
+        waited = false;
+        break;
+      }
+    } else {
+      pthread_cond_wait(&data->cond, &data->mutex);
+    }
+  }
+
+  __sync_fetch_and_sub(&data->waiters, 1);
+
+  pthread_mutex_unlock(&data->mutex);
+
+  return waited;
 }
 
 
@@ -415,18 +494,17 @@ T Future<T>::get() const
     abort();
   }
 
-  assert(t != NULL);
-  assert(*t != NULL);
-  return **t;
+  assert(data->t != NULL);
+  return *data->t;
 }
 
 
 template <typename T>
 std::string Future<T>::failure() const
 {
-  assert(message != NULL);
-  if (*message != NULL) {
-    return **message;
+  assert(data != NULL);
+  if (data->message != NULL) {
+    return *data->message;
   }
 
   return "";
@@ -438,21 +516,20 @@ const Future<T>& Future<T>::onReady(const ReadyCallback& callback) const
 {
   bool run = false;
 
-  assert(lock != NULL);
-  internal::acquire(lock);
+  assert(data != NULL);
+  internal::acquire(&data->lock);
   {
-    assert(state != NULL);
-    if (*state == READY) {
+    if (data->state == READY) {
       run = true;
-    } else if (*state == PENDING) {
-      onReadyCallbacks->push(callback);
+    } else if (data->state == PENDING) {
+      data->onReadyCallbacks.push_back(callback);
     }
   }
-  internal::release(lock);
+  internal::release(&data->lock);
 
   // TODO(*): Invoke callback in another execution context.
   if (run) {
-    callback(**t);
+    callback(*data->t);
   }
 
   return *this;
@@ -464,21 +541,20 @@ const Future<T>& Future<T>::onFailed(const FailedCallback& callback) const
 {
   bool run = false;
 
-  assert(lock != NULL);
-  internal::acquire(lock);
+  assert(data != NULL);
+  internal::acquire(&data->lock);
   {
-    assert(state != NULL);
-    if (*state == FAILED) {
+    if (data->state == FAILED) {
       run = true;
-    } else if (*state == PENDING) {
-      onFailedCallbacks->push(callback);
+    } else if (data->state == PENDING) {
+      data->onFailedCallbacks.push_back(callback);
     }
   }
-  internal::release(lock);
+  internal::release(&data->lock);
 
   // TODO(*): Invoke callback in another execution context.
   if (run) {
-    callback(**message);
+    callback(*data->message);
   }
 
   return *this;
@@ -491,17 +567,16 @@ const Future<T>& Future<T>::onDiscarded(
 {
   bool run = false;
 
-  assert(lock != NULL);
-  internal::acquire(lock);
+  assert(data != NULL);
+  internal::acquire(&data->lock);
   {
-    assert(state != NULL);
-    if (*state == DISCARDED) {
+    if (data->state == DISCARDED) {
       run = true;
-    } else if (*state == PENDING) {
-      onDiscardedCallbacks->push(callback);
+    } else if (data->state == PENDING) {
+      data->onDiscardedCallbacks.push_back(callback);
     }
   }
-  internal::release(lock);
+  internal::release(&data->lock);
 
   // TODO(*): Invoke callback in another execution context.
   if (run) {
@@ -517,17 +592,16 @@ const Future<T>& Future<T>::onAny(const AnyCallback& callback) const
 {
   bool run = false;
 
-  assert(lock != NULL);
-  internal::acquire(lock);
+  assert(data != NULL);
+  internal::acquire(&data->lock);
   {
-    assert(state != NULL);
-    if (*state != PENDING) {
+    if (data->state != PENDING) {
       run = true;
-    } else if (*state == PENDING) {
-      onAnyCallbacks->push(callback);
+    } else {
+      data->onAnyCallbacks.push_back(callback);
     }
   }
-  internal::release(lock);
+  internal::release(&data->lock);
 
   // TODO(*): Invoke callback in another execution context.
   if (run) {
@@ -543,34 +617,34 @@ bool Future<T>::set(const T& _t)
 {
   bool result = false;
 
-  assert(lock != NULL);
-  internal::acquire(lock);
+  assert(data != NULL);
+  internal::acquire(&data->lock);
   {
-    assert(state != NULL);
-    if (*state == PENDING) {
-      *t = new T(_t);
-      *state = READY;
-      latch->trigger();
+    if (data->state == PENDING) {
+      data->t = new (data->storage) T(_t);
+      data->state = READY;
       result = true;
     }
   }
-  internal::release(lock);
+  internal::release(&data->lock);
 
   // Invoke all callbacks associated with this future being READY. We
   // don't need a lock because the state is now in READY so there
   // should not be any concurrent modications.
   if (result) {
-    while (!onReadyCallbacks->empty()) {
+    wakeup();
+
+    for (size_t i = 0; i < data->onReadyCallbacks.size(); i++) {
       // TODO(*): Invoke callbacks in another execution context.
-      onReadyCallbacks->front()(**t);
-      onReadyCallbacks->pop();
+      data->onReadyCallbacks[i](*data->t);
     }
+    data->onReadyCallbacks.clear();
 
-    while (!onAnyCallbacks->empty()) {
+    for (size_t i = 0; i < data->onAnyCallbacks.size(); i++) {
       // TODO(*): Invoke callbacks in another execution context.
-      onAnyCallbacks->front()(*this);
-      onAnyCallbacks->pop();
+      data->onAnyCallbacks[i](*this);
     }
+    data->onAnyCallbacks.clear();
   }
 
   return result;
@@ -582,70 +656,75 @@ bool Future<T>::fail(const std::string& _message)
 {
   bool result = false;
 
-  assert(lock != NULL);
-  internal::acquire(lock);
+  assert(data != NULL);
+  internal::acquire(&data->lock);
   {
-    assert(state != NULL);
-    if (*state == PENDING) {
-      *message = new std::string(_message);
-      *state = FAILED;
-      latch->trigger();
+    if (data->state == PENDING) {
+      data->message = new std::string(_message);
+      data->state = FAILED;
       result = true;
     }
   }
-  internal::release(lock);
+  internal::release(&data->lock);
 
   // Invoke all callbacks associated with this future being FAILED. We
   // don't need a lock because the state is now in FAILED so there
   // should not be any concurrent modications.
   if (result) {
-    while (!onFailedCallbacks->empty()) {
+    wakeup();
+
+    for (size_t i = 0; i < data->onFailedCallbacks.size(); i++) {
       // TODO(*): Invoke callbacks in another execution context.
-      onFailedCallbacks->front()(**message);
-      onFailedCallbacks->pop();
+      data->onFailedCallbacks[i](*data->message);
     }
+    data->onFailedCallbacks.clear();
 
-    while (!onAnyCallbacks->empty()) {
+    for (size_t i = 0; i < data->onAnyCallbacks.size(); i++) {
       // TODO(*): Invoke callbacks in another execution context.
-      onAnyCallbacks->front()(*this);
-      onAnyCallbacks->pop();
+      data->onAnyCallbacks[i](*this);
     }
+    data->onAnyCallbacks.clear();
   }
 
   return result;
 }
 
 
+template <typename T>
+void Future<T>::wakeup()
+{
+  // Releasing the lock (after changing the state) is a full memory
+  // barrier, so either we see a waiter here or the waiter sees the
+  // new state (see 'await').
+  if (data->waiters > 0) {
+    pthread_mutex_lock(&data->mutex);
+    pthread_cond_broadcast(&data->cond);
+    pthread_mutex_unlock(&data->mutex);
+  }
+}
+
+
 template <typename T>
 void Future<T>::copy(const Future<T>& that)
 {
-  assert(that.refs > 0);
-  __sync_fetch_and_add(that.refs, 1);
-  refs = that.refs;
-  lock = that.lock;
-  state = that.state;
-  t = that.t;
-  message = that.message;
-  onReadyCallbacks = that.onReadyCallbacks;
-  onFailedCallbacks = that.onFailedCallbacks;
-  onDiscardedCallbacks = that.onDiscardedCallbacks;
-  onAnyCallbacks = that.onAnyCallbacks;
-  latch = that.latch;
+  assert(that.data != NULL);
+  assert(that.data->refs > 0);
+  __sync_fetch_and_add(&that.data->refs, 1);
+  data = that.data;
 }
 
 
 template <typename T>
 void Future<T>::cleanup()
 {
-  assert(refs != NULL);
-  if (__sync_sub_and_fetch(refs, 1) == 0) {
+  assert(data != NULL);
+  if (__sync_sub_and_fetch(&data->refs, 1) == 0) {
     // Discard the future if it is still pending (so we invoke any
     // discarded callbacks that have been setup). Note that we put the
     // reference count back at 1 here in case one of the callbacks
     // decides it wants to keep a reference.
-    assert(state != NULL);
-    if (*state == PENDING) {
-      *refs = 1;
+    if (data->state == PENDING) {
+      data->refs = 1;
       discard();
     }
 
@@ -654,39 +733,9 @@ void Future<T>::cleanup()
     // callbacks might have stored the future, in which case we'll
     // just return without doing anything, but the state will forever
     // be "discarded".
-    assert(refs != NULL);
-    if (__sync_sub_and_fetch(refs, 1) == 0) {
-      delete refs;
-      refs = NULL;
-      assert(lock != NULL);
-      delete lock;
-      lock = NULL;
-      assert(state != NULL);
-      delete state;
-      state = NULL;
-      assert(t != NULL);
-      delete *t;
-      delete t;
-      t = NULL;
-      assert(message != NULL);
-      delete *message;
-      delete message;
-      message = NULL;
-      assert(onReadyCallbacks != NULL);
-      delete onReadyCallbacks;
-      onReadyCallbacks = NULL;
-      assert(onFailedCallbacks != NULL);
-      delete onFailedCallbacks;
-      onFailedCallbacks = NULL;
-      assert(onDiscardedCallbacks != NULL);
-      delete onDiscardedCallbacks;
-      onDiscardedCallbacks = NULL;
-      assert(onAnyCallbacks != NULL);
-      delete onAnyCallbacks;
-      onAnyCallbacks = NULL;
-      assert(latch != NULL);
-      delete latch;
-      latch = NULL;
+    if (__sync_sub_and_fetch(&data->refs, 1) == 0) {
+      delete data;
+      data = NULL;
     }
   }
 }
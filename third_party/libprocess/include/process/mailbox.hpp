@@ -0,0 +1,188 @@
+#ifndef __PROCESS_MAILBOX_HPP__
+#define __PROCESS_MAILBOX_HPP__
+
+#include <stdlib.h> // For NULL.
+
+#include <sys/time.h>
+
+#include <process/event.hpp>
+
+namespace process {
+
+// An intrusive, lock-free, multiple-producer/single-consumer queue of
+// events (the events are linked together via Event::next so enqueuing
+// never allocates). Producers push events onto one of two lock-free
+// stacks, one for regular events and one for "injected" events. The
+// consumer takes all of the events off of a stack at once, reversing
+// the regular events so that they get served in FIFO order. Injected
+// events are served before all other events, the most recently
+// injected event first (i.e., like pushing onto the front of a
+// deque). Only a single thread may 'pop' at a time, but any thread
+// may 'push' or 'inject' concurrently.
+//
+// The mailbox also counts the events it holds and keeps track of how
+// long the most recently popped event was queued for, so that it can
+// be seen when a process can't keep up with its events.
+class Mailbox
+{
+public:
+  Mailbox() : head(NULL), injected(NULL), pending(NULL), count(0), delay(0) {}
+
+  // Adds the event to the back of the mailbox.
+  void push(Event* event)
+  {
+    push(&head, event);
+  }
+
+  // Adds the event to the front of the mailbox.
+  void inject(Event* event)
+  {
+    push(&injected, event);
+  }
+
+  // Removes and returns the event at the front of the mailbox, or
+  // NULL if the mailbox is empty (consumer only).
+  Event* pop()
+  {
+    if (injected != NULL) {
+      Event* events = __sync_lock_test_and_set(&injected, NULL);
+
+      // The injected events are already in the order we want to
+      // serve them, just put them in front of the pending events.
+      if (events != NULL) {
+        Event* last = events;
+        while (last->next != NULL) {
+          last = last->next;
+        }
+        last->next = pending;
+        pending = events;
+      }
+    }
+
+    if (pending == NULL && head != NULL) {
+      Event* events = __sync_lock_test_and_set(&head, NULL);
+
+      // Reverse the events so that we serve them in FIFO order.
+      while (events != NULL) {
+        Event* next = events->next;
+        events->next = pending;
+        pending = events;
+        events = next;
+      }
+    }
+
+    Event* event = pending;
+
+    if (event != NULL) {
+      pending = event->next;
+      event->next = NULL;
+      __sync_fetch_and_sub(&count, 1);
+      delay = now() - event->time;
+    }
+
+    return event;
+  }
+
+  // Removes and returns the first event (in the order they get
+  // served, not counting events injected since the last 'pop') for
+  // which 'predicate' returns true, or NULL if there is none. Like
+  // with 'pop', only a single thread may do this at a time (i.e., it
+  // needs to synchronize with the consumer).
+  template <typename Predicate>
+  Event* remove(const Predicate& predicate)
+  {
+    // Move the events pushed so far behind the pending events so
+    // that all of them can be looked at in the order they get served.
+    if (head != NULL) {
+      Event* events = __sync_lock_test_and_set(&head, NULL);
+
+      Event* reversed = NULL;
+      while (events != NULL) {
+        Event* next = events->next;
+        events->next = reversed;
+        reversed = events;
+        events = next;
+      }
+
+      Event** tail = &pending;
+      while (*tail != NULL) {
+        tail = &(*tail)->next;
+      }
+      *tail = reversed;
+    }
+
+    for (Event** link = &pending; *link != NULL; link = &(*link)->next) {
+      if (predicate(*link)) {
+        Event* event = *link;
+        *link = event->next;
+        event->next = NULL;
+        __sync_fetch_and_sub(&count, 1);
+        return event;
+      }
+    }
+
+    return NULL;
+  }
+
+  // Returns true if there are no events in the mailbox. Note that
+  // unless invoked by the consumer the result might be stale.
+  bool empty() const
+  {
+    return pending == NULL && head == NULL && injected == NULL;
+  }
+
+  // Returns the number of events in the mailbox (might be stale).
+  size_t size() const
+  {
+    return count;
+  }
+
+  // Returns how many seconds the most recently popped event spent in
+  // the mailbox (might be stale unless invoked by the consumer).
+  double age() const
+  {
+    return delay;
+  }
+
+  // Current time in seconds, used for measuring how long events are
+  // queued for.
+  static double now()
+  {
+    timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+  }
+
+private:
+  void push(Event* volatile* stack, Event* event)
+  {
+    event->time = now();
+
+    __sync_fetch_and_add(&count, 1);
+
+    Event* top;
+    do {
+      top = *stack;
+      event->next = top;
+    } while (!__sync_bool_compare_and_swap(stack, top, event));
+  }
+
+  // Not copyable, not assignable.
+  Mailbox(const Mailbox&);
+  Mailbox& operator = (const Mailbox&);
+
+  // Stacks of events pushed by producers (most recent event first).
+  Event* volatile head;
+  Event* volatile injected;
+
+  // Events taken off of the stacks in the order they should be
+  // served (only accessed by the consumer).
+  Event* pending;
+
+  volatile int count;
+  volatile double delay;
+};
+
+} // namespace process {
+
+#endif // __PROCESS_MAILBOX_HPP__
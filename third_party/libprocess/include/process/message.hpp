@@ -3,6 +3,7 @@
 
 #include <string>
 
+#include <process/buffer.hpp>
 #include <process/pid.hpp>
 
 namespace process {
@@ -12,7 +13,7 @@ struct Message
   std::string name;
   UPID from;
   UPID to;
-  std::string body;
+  Buffer body;
 };
 
 } // namespace process {
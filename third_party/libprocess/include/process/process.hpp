@@ -6,18 +6,28 @@
 
 #include <map>
 #include <queue>
+#include <set>
+#include <string>
 
 #include <tr1/functional>
 
+#include <process/buffer.hpp>
 #include <process/clock.hpp>
 #include <process/event.hpp>
 #include <process/filter.hpp>
 #include <process/http.hpp>
+#include <process/mailbox.hpp>
 #include <process/message.hpp>
 #include <process/pid.hpp>
 
 namespace process {
 
+// Name of the message a process sends back to the sender of a message
+// that it rejected because its mailbox was full (the body is the name
+// of the rejected message, see ProcessBase::capacity).
+const char* const OVERLOADED = "libprocess::overloaded";
+
+
 class ProcessBase : public EventVisitor
 {
 public:
@@ -27,6 +37,65 @@ public:
 
   UPID self() const { return pid; }
 
+  // What happens to events when the mailbox is full (see 'capacity').
+  enum Overflow {
+    // The oldest queued droppable message (see 'capacity') gets
+    // dropped to make room for a new message, or the new message
+    // itself if it is droppable and no other droppable message is
+    // queued. Useful for idempotent messages (e.g., pings). Messages
+    // that aren't droppable always get queued.
+    DROP_OLDEST,
+
+    // New messages get dropped and their senders get an OVERLOADED
+    // message.
+    REJECT,
+
+    // Senders block until the mailbox is no longer full. Only threads
+    // that are not running a process (e.g., the threads of an
+    // application calling dispatch) get blocked, everything else
+    // gets queued since blocking a processing or I/O thread could
+    // deadlock.
+    BLOCK,
+  };
+
+  // Limits how many events can be queued for this process, 0 (the
+  // default) means unlimited. Only messages get dropped or rejected,
+  // other events (e.g., dispatches or exited events) always get
+  // queued. With DROP_OLDEST only the messages with one of the names
+  // in 'droppable' ever get dropped. Must be called before the
+  // process gets spawned. The size of the mailbox and how long events
+  // spend in it are available at /__statistics__/mailboxes.json.
+  void capacity(size_t events,
+                Overflow overflow,
+                const std::set<std::string>& droppable =
+                  std::set<std::string>())
+  {
+    limit = events;
+    policy = overflow;
+    this->droppable = droppable;
+  }
+
+  // Instrumentation of the events handled by a process, updated by
+  // the thread running the process and available (for all processes)
+  // at /__processes__.
+  struct Statistics
+  {
+    enum { MESSAGE, DISPATCH, HTTP, EXITED, TERMINATE, TYPES };
+
+    // Bucket 0 counts events handled in less than a microsecond,
+    // bucket N (N > 0) the events handled in [2^(N-1), 2^N)
+    // microseconds and the last bucket everything slower.
+    enum { BUCKETS = 24 };
+
+    uint64_t events[TYPES];      // Events handled, by type.
+    uint64_t handling[BUCKETS];  // Histogram of the handler times.
+    double handled;              // Total seconds spent handling events.
+    double slowest;              // Slowest handler in seconds.
+    double queued;               // Total seconds events spent queued.
+    double longest;              // Longest an event was queued in seconds.
+    size_t high;                 // Most events queued at once.
+  };
+
 protected:
   // Invoked when an event is serviced.
   virtual void serve(const Event& event)
@@ -67,6 +136,12 @@ protected:
       const char* data = NULL,
       size_t length = 0);
 
+  // Sends a message with a body to PID, without copying the body.
+  void send(
+      const UPID& to,
+      const std::string& name,
+      const Buffer& body);
+
   // Links with the specified PID. Linking with a process from within
   // the same "operating system process" is gauranteed to give you
   // perfect monitoring of that process. However, linking with a
@@ -147,23 +222,57 @@ private:
   friend class ProcessReference;
   friend void* schedule(void*);
 
-  // Process states.
+  // Process states. A process transitions from BLOCKED to READY
+  // when an event gets enqueued (via a compare-and-swap, so exactly
+  // one enqueuer puts the process on a run queue) and only the
+  // thread running the process makes all other transitions.
   enum { BOTTOM,
          READY,
 	 RUNNING,
          BLOCKED,
-	 FINISHED } state;
+	 FINISHED };
 
-  // Mutex protecting internals. TODO(benh): Replace with a spinlock.
-  pthread_mutex_t m;
-  void lock() { pthread_mutex_lock(&m); }
-  void unlock() { pthread_mutex_unlock(&m); }
+  volatile int state;
 
   // Enqueue the specified message, request, or function call.
   void enqueue(Event* event, bool inject = false);
 
-  // Queue of received events.
-  std::deque<Event*> events;
+  // Applies the overflow policy to an event that is being enqueued
+  // while the mailbox is full, returns false if the event has been
+  // dropped.
+  bool overflow(Event* event);
+
+  // Queue of received events (lock-free, see mailbox.hpp).
+  Mailbox events;
+
+  // Capacity of the mailbox (see 'capacity').
+  size_t limit;
+  Overflow policy;
+  std::set<std::string> droppable;
+
+  // With DROP_OLDEST enqueuers evict messages from the mailbox, so
+  // they and the thread running the process hold this lock while
+  // using the mailbox (see ProcessBase::overflow).
+  pthread_mutex_t eviction;
+
+  // Number of messages dropped and rejected, and senders blocked,
+  // because the mailbox was full.
+  struct {
+    uint64_t dropped;
+    uint64_t rejected;
+    uint64_t blocked;
+  } overflows;
+
+  // Senders blocked because the mailbox is full wait on 'cond' until
+  // the process makes room (see ProcessManager::resume) or finishes.
+  struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    volatile int waiters;
+  } drain;
+
+  // Instrumentation (see ProcessManager::resume).
+  Statistics statistics;
 
   // Delegates for messages.
   std::map<std::string, UPID> delegates;
@@ -177,6 +286,9 @@ private:
   // Active references.
   int refs;
 
+  // Processing thread this process last ran on (or -1 if never run).
+  int thread;
+
   // Process PID.
   UPID pid;
 };
@@ -198,8 +310,37 @@ public:
  * @param initialize_google_logging whether or not to initialize the
  *        Google Logging library (glog). If the application is also
  *        using glog, this should be set to false.
+ * @param threads number of processing threads to use, 0 implies use
+ *        LIBPROCESS_THREADS from the environment if set or otherwise
+ *        the number of cores (but at least 4). Note that this only
+ *        has an effect on the first call to initialize (including the
+ *        implicit calls made when spawning or constructing processes).
+ *
+ * The processing threads can be restricted to (and pinned, one cpu
+ * per thread, to) the cpus in LIBPROCESS_CPUS, and the I/O threads
+ * restricted to the cpus in LIBPROCESS_IO_CPUS. Both are lists such
+ * as "0-3,8" where "nodeN" stands for all of the cpus on NUMA node
+ * N. If only LIBPROCESS_IO_CPUS is set, the processing threads avoid
+ * those cpus.
+ *
+ * Sockets are spread over LIBPROCESS_IO_THREADS (default 1) event
+ * loops, each run by its own I/O thread.
+ *
+ * Sockets used for sending messages get TCP_NODELAY set unless
+ * LIBPROCESS_TCP_NODELAY=0, and get corked (TCP_CORK) while bursts of
+ * messages are written if LIBPROCESS_TCP_CORK=1. Sockets created for
+ * sending to processes that haven't been linked to are kept open for
+ * reuse once idle, up to LIBPROCESS_POOL_SIZE (default 64, 0 closes
+ * them right away) sockets for LIBPROCESS_POOL_IDLE_TIMEOUT (default
+ * 30) seconds. Statistics about sending (and connecting) are
+ * available at /__statistics__/sockets.json.
+ *
+ * The events handled by each process (by type), how long handling
+ * them took (including a histogram), how long they were queued for
+ * and the most events that were queued at once are available at
+ * /__processes__.
  */
-void initialize(bool initialize_google_logging = true);
+void initialize(bool initialize_google_logging = true, int threads = 0);
 
 
 /**
@@ -267,6 +408,18 @@ void post(const UPID& to,
           size_t length = 0);
 
 
+/**
+ * Sends a message with a body without a return address.
+ *
+ * @param to receiver
+ * @param name message name
+ * @param body body to send (does not get copied)
+ */
+void post(const UPID& to,
+          const std::string& name,
+          const Buffer& body);
+
+
 // Inline implementations of above.
 inline void terminate(const ProcessBase& process, bool inject)
 {
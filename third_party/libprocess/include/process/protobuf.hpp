@@ -1,6 +1,8 @@
 #ifndef __PROCESS_PROTOBUF_HPP__
 #define __PROCESS_PROTOBUF_HPP__
 
+#include <stdlib.h>
+
 #include <glog/logging.h>
 
 #include <google/protobuf/message.h>
@@ -24,7 +26,43 @@ inline void post(const process::UPID& to,
 {
   std::string data;
   message.SerializeToString(&data);
-  post(to, message.GetTypeName(), data.data(), data.size());
+  post(to, message.GetTypeName(), process::Buffer::take(&data));
+}
+
+
+// Holds a protobuf message in a Buffer (see Buffer::Object) so that a
+// message sent to a process in the same operating system process can
+// be handed over without serializing and parsing it.
+class ProtobufObject : public Buffer::Object
+{
+public:
+  // Takes ownership of the message.
+  explicit ProtobufObject(google::protobuf::Message* _message)
+    : message(_message) {}
+
+  virtual ~ProtobufObject()
+  {
+    delete message;
+  }
+
+  virtual void serialize(std::string* data) const
+  {
+    message->SerializeToString(data);
+  }
+
+  const google::protobuf::Message* const message;
+};
+
+
+// Returns whether or not protobuf messages sent to processes in the
+// same operating system process get handed over as message objects
+// (see ProtobufProcess::send), which can be disabled by setting the
+// environment variable LIBPROCESS_LOCAL_PROTOBUFS=0.
+inline bool local_protobufs()
+{
+  static const bool enabled = getenv("LIBPROCESS_LOCAL_PROTOBUFS") == NULL ||
+    atoi(getenv("LIBPROCESS_LOCAL_PROTOBUFS")) != 0;
+  return enabled;
 }
 
 } // namespace process {
@@ -86,10 +124,25 @@ protected:
   void send(const process::UPID& to,
             const google::protobuf::Message& message)
   {
+    const process::UPID& self = process::Process<T>::self();
+
+    // Hand a copy of the message to local receivers rather than
+    // serializing it (it still gets serialized if it has to be, e.g.,
+    // if the receiver doesn't handle it as a protobuf).
+    if (to.ip == self.ip && to.port == self.port &&
+        process::local_protobufs()) {
+      google::protobuf::Message* copy = message.New();
+      copy->CopyFrom(message);
+      process::Process<T>::send(
+          to, message.GetTypeName(),
+          process::Buffer::wrap(new process::ProtobufObject(copy)));
+      return;
+    }
+
     std::string data;
     message.SerializeToString(&data);
     process::Process<T>::send(to, message.GetTypeName(),
-                              data.data(), data.size());
+                              process::Buffer::take(&data));
   }
 
   using process::Process<T>::send;
@@ -97,8 +150,6 @@ protected:
   void reply(const google::protobuf::Message& message)
   {
     CHECK(from) << "Attempting to reply without a sender";
-    std::string data;
-    message.SerializeToString(&data);
     send(from, message);
   }
 
@@ -221,12 +272,32 @@ protected:
   process::UPID from; // Sender of "current" message, accessible by subclasses.
 
 private:
+  // Returns the message held by the body if it was sent from within
+  // this operating system process (see 'send'), or otherwise parses
+  // the body into 'temp' and returns that.
+  template <typename M>
+  static const M& parse(const process::Buffer& data, M* temp)
+  {
+    const process::ProtobufObject* object =
+      dynamic_cast<const process::ProtobufObject*>(data.object());
+
+    if (object != NULL) {
+      const M* m = dynamic_cast<const M*>(object->message);
+      if (m != NULL) {
+        return *m;
+      }
+    }
+
+    temp->ParseFromString(data);
+    return *temp;
+  }
+
   template <typename M>
   static void handlerM(T* t, void (T::*method)(const M&),
-                       const std::string& data)
+                       const process::Buffer& data)
   {
-    M m;
-    m.ParseFromString(data);
+    M temp;
+    const M& m = parse(data, &temp);
     if (m.IsInitialized()) {
       (t->*method)(m);
     } else {
@@ -236,7 +307,7 @@ private:
   }
 
   static void handler0(T* t, void (T::*method)(),
-                       const std::string& data)
+                       const process::Buffer& data)
   {
     (t->*method)();
   }
@@ -245,10 +316,10 @@ private:
             typename P1, typename P1C>
   static void handler1(T* t, void (T::*method)(P1C),
                        P1 (M::*p1)() const,
-                       const std::string& data)
+                       const process::Buffer& data)
   {
-    M m;
-    m.ParseFromString(data);
+    M temp;
+    const M& m = parse(data, &temp);
     if (m.IsInitialized()) {
       (t->*method)(google::protobuf::convert((&m->*p1)()));
     } else {
@@ -263,10 +334,10 @@ private:
   static void handler2(T* t, void (T::*method)(P1C, P2C),
                        P1 (M::*p1)() const,
                        P2 (M::*p2)() const,
-                       const std::string& data)
+                       const process::Buffer& data)
   {
-    M m;
-    m.ParseFromString(data);
+    M temp;
+    const M& m = parse(data, &temp);
     if (m.IsInitialized()) {
       (t->*method)(google::protobuf::convert((&m->*p1)()),
                    google::protobuf::convert((&m->*p2)()));
@@ -284,10 +355,10 @@ private:
                        P1 (M::*p1)() const,
                        P2 (M::*p2)() const,
                        P3 (M::*p3)() const,
-                       const std::string& data)
+                       const process::Buffer& data)
   {
-    M m;
-    m.ParseFromString(data);
+    M temp;
+    const M& m = parse(data, &temp);
     if (m.IsInitialized()) {
       (t->*method)(google::protobuf::convert((&m->*p1)()),
                    google::protobuf::convert((&m->*p2)()),
@@ -308,10 +379,10 @@ private:
                        P2 (M::*p2)() const,
                        P3 (M::*p3)() const,
                        P4 (M::*p4)() const,
-                       const std::string& data)
+                       const process::Buffer& data)
   {
-    M m;
-    m.ParseFromString(data);
+    M temp;
+    const M& m = parse(data, &temp);
     if (m.IsInitialized()) {
       (t->*method)(google::protobuf::convert((&m->*p1)()),
                    google::protobuf::convert((&m->*p2)()),
@@ -335,10 +406,10 @@ private:
                        P3 (M::*p3)() const,
                        P4 (M::*p4)() const,
                        P5 (M::*p5)() const,
-                       const std::string& data)
+                       const process::Buffer& data)
   {
-    M m;
-    m.ParseFromString(data);
+    M temp;
+    const M& m = parse(data, &temp);
     if (m.IsInitialized()) {
       (t->*method)(google::protobuf::convert((&m->*p1)()),
                    google::protobuf::convert((&m->*p2)()),
@@ -351,7 +422,7 @@ private:
     }
   }
 
-  typedef std::tr1::function<void(const std::string&)> handler;
+  typedef std::tr1::function<void(const process::Buffer&)> handler;
   std::tr1::unordered_map<std::string, handler> protobufHandlers;
 };
 
@@ -0,0 +1,1190 @@
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+
+#include <netinet/in.h>
+
+#include <sys/socket.h>
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <new>
+#include <set>
+#include <sstream>
+#include <vector>
+
+#include <process/clock.hpp>
+#include <process/dispatch.hpp>
+#include <process/future.hpp>
+#include <process/process.hpp>
+#include <process/timer.hpp>
+
+#include "decoder.hpp"
+#include "encoder.hpp"
+
+using namespace process;
+
+using std::deque;
+using std::map;
+using std::set;
+using std::string;
+using std::vector;
+
+
+// Each benchmark prints its results as a JSON object on a line of its
+// own, for example:
+//
+//   {"benchmark":"spawn","processes":1000,"spawns_per_sec":...}
+//
+// so that the output (see 'make libprocess-bench') can be collected
+// and compared across versions.
+class Report
+{
+public:
+  explicit Report(const string& benchmark)
+  {
+    out << "{\"benchmark\":\"" << benchmark << "\"";
+  }
+
+  template <typename T>
+  Report& add(const string& key, const T& value)
+  {
+    out << ",\"" << key << "\":" << value;
+    return *this;
+  }
+
+  Report& add(const string& key, double value)
+  {
+    out << ",\"" << key << "\":"
+        << std::fixed << std::setprecision(3) << value;
+    return *this;
+  }
+
+  Report& add(const string& key, const char* value)
+  {
+    out << ",\"" << key << "\":\"" << value << "\"";
+    return *this;
+  }
+
+  void print()
+  {
+    std::cout << out.str() << "}" << std::endl;
+  }
+
+private:
+  std::ostringstream out;
+};
+
+
+// Adds the average, median, 99th percentile and worst of the given
+// latencies (in microseconds) to a report.
+void percentiles(Report* report, vector<double> latencies)
+{
+  CHECK(!latencies.empty());
+
+  std::sort(latencies.begin(), latencies.end());
+
+  double total = 0;
+  foreach (double latency, latencies) {
+    total += latency;
+  }
+
+  const size_t size = latencies.size();
+
+  report->add("mean_usecs", total / size * 1000000)
+    .add("p50_usecs", latencies[size / 2] * 1000000)
+    .add("p99_usecs", latencies[std::min(size - 1, size * 99 / 100)] * 1000000)
+    .add("max_usecs", latencies[size - 1] * 1000000);
+}
+
+
+// Counts the allocations (and bytes allocated) made by the current
+// thread, see 'benchmarkBodies'.
+static __thread uint64_t allocations = 0;
+static __thread uint64_t allocated = 0;
+
+
+void* operator new (size_t size) throw (std::bad_alloc)
+{
+  allocations++;
+  allocated += size;
+  void* pointer = malloc(size);
+  if (pointer == NULL) {
+    throw std::bad_alloc();
+  }
+  return pointer;
+}
+
+
+void operator delete (void* pointer) throw ()
+{
+  free(pointer);
+}
+
+
+// Measures the round-trip latency of a dispatch from a thread that
+// isn't running a process (i.e., dispatching and then waiting on the
+// future), one dispatch at a time.
+class EchoProcess : public Process<EchoProcess>
+{
+public:
+  int echo(int i)
+  {
+    return i;
+  }
+};
+
+
+void benchmarkRoundTrip(int count)
+{
+  EchoProcess process;
+  spawn(process);
+
+  vector<double> latencies;
+  latencies.reserve(count);
+
+  double start = Clock::now();
+
+  for (int i = 0; i < count; i++) {
+    double sent = Clock::now();
+    Future<int> future = dispatch(process, &EchoProcess::echo, i);
+    future.await();
+    CHECK(future.get() == i);
+    latencies.push_back(Clock::now() - sent);
+  }
+
+  double elapsed = Clock::now() - start;
+
+  Report report("roundtrip");
+  report.add("dispatches", count)
+    .add("dispatches_per_sec", count / elapsed);
+  percentiles(&report, latencies);
+  report.print();
+
+  terminate(process);
+  wait(process);
+}
+
+
+// Measures the throughput of dispatches that return a result (i.e.,
+// each one creates a future), by dispatching a batch at a time and
+// then waiting for all of the results.
+void benchmarkResults(int count)
+{
+  EchoProcess process;
+  spawn(process);
+
+  const int batch = 1000;
+
+  vector<Future<int> > futures;
+  futures.reserve(batch);
+
+  double start = Clock::now();
+
+  for (int i = 0; i < count; i += batch) {
+    for (int j = 0; j < batch; j++) {
+      futures.push_back(dispatch(process, &EchoProcess::echo, j));
+    }
+
+    for (int j = 0; j < batch; j++) {
+      CHECK(futures[j].get() == j);
+    }
+
+    futures.clear();
+  }
+
+  double elapsed = Clock::now() - start;
+
+  int dispatches = (count + batch - 1) / batch * batch;
+
+  Report("results")
+    .add("dispatches", dispatches)
+    .add("dispatches_per_sec", dispatches / elapsed)
+    .print();
+
+  terminate(process);
+  wait(process);
+}
+
+
+// Measures the allocations made by the dispatching thread per
+// dispatch, for methods returning nothing, a value and a future.
+class CallProcess : public Process<CallProcess>
+{
+public:
+  void call(int i, const string& s) {}
+
+  int value(int i, const string& s)
+  {
+    return i;
+  }
+
+  Future<int> future(int i, const string& s)
+  {
+    return i;
+  }
+};
+
+
+void benchmarkAllocations(int count)
+{
+  CallProcess process;
+  spawn(process);
+
+  const string s = "dispatch";
+
+  Future<int> future;
+
+  uint64_t start = allocations;
+
+  for (int i = 0; i < count; i++) {
+    dispatch(process, &CallProcess::call, i, s);
+  }
+
+  uint64_t voids = allocations - start;
+
+  start = allocations;
+
+  for (int i = 0; i < count; i++) {
+    future = dispatch(process, &CallProcess::value, i, s);
+  }
+
+  uint64_t values = allocations - start;
+
+  start = allocations;
+
+  for (int i = 0; i < count; i++) {
+    future = dispatch(process, &CallProcess::future, i, s);
+  }
+
+  uint64_t futures = allocations - start;
+
+  future.await();
+
+  Report("allocations")
+    .add("dispatches", count)
+    .add("void_allocations_per_dispatch", (double) voids / count)
+    .add("value_allocations_per_dispatch", (double) values / count)
+    .add("future_allocations_per_dispatch", (double) futures / count)
+    .print();
+
+  terminate(process);
+  wait(process);
+}
+
+
+// Measures how many dispatches per second the processing threads can
+// sustain when many independent pairs of processes are "bouncing"
+// dispatches back and forth. Each pair can make progress on its own,
+// so throughput should scale with the number of cores (try running
+// under 'taskset' with a varying number of cpus).
+class BounceProcess : public Process<BounceProcess>
+{
+public:
+  BounceProcess() : promise(NULL) {}
+
+  void start(const PID<BounceProcess>& _peer,
+             int count,
+             Promise<bool>* _promise)
+  {
+    peer = _peer;
+    promise = _promise;
+    dispatch(peer, &BounceProcess::bounce, self(), count);
+  }
+
+  void bounce(const PID<BounceProcess>& from, int count)
+  {
+    if (count == 0) {
+      dispatch(from, &BounceProcess::done);
+    } else {
+      dispatch(from, &BounceProcess::bounce, self(), count - 1);
+    }
+  }
+
+  void done()
+  {
+    CHECK(promise != NULL);
+    promise->set(true);
+  }
+
+private:
+  PID<BounceProcess> peer;
+  Promise<bool>* promise;
+};
+
+
+void benchmarkDispatch(int pairs, int count)
+{
+  vector<BounceProcess*> processes;
+  vector<Promise<bool>*> promises;
+
+  for (int i = 0; i < pairs * 2; i++) {
+    BounceProcess* process = new BounceProcess();
+    spawn(process);
+    processes.push_back(process);
+  }
+
+  double start = Clock::now();
+
+  for (int i = 0; i < pairs; i++) {
+    Promise<bool>* promise = new Promise<bool>();
+    promises.push_back(promise);
+    dispatch(processes[i * 2],
+             &BounceProcess::start,
+             processes[i * 2 + 1]->self(),
+             count,
+             promise);
+  }
+
+  for (int i = 0; i < pairs; i++) {
+    promises[i]->future().await();
+  }
+
+  double elapsed = Clock::now() - start;
+
+  // Each pair does 'count' bounces plus the start and done dispatch.
+  uint64_t dispatches = (uint64_t) pairs * (count + 2);
+
+  Report("dispatch")
+    .add("pairs", pairs)
+    .add("dispatches", dispatches)
+    .add("secs", elapsed)
+    .add("dispatches_per_sec", dispatches / elapsed)
+    .print();
+
+  for (int i = 0; i < pairs * 2; i++) {
+    terminate(processes[i]);
+    wait(processes[i]);
+    delete processes[i];
+  }
+
+  for (int i = 0; i < pairs; i++) {
+    delete promises[i];
+  }
+}
+
+
+// Measures how fast multiple (non-libprocess) threads can dispatch
+// into a single process, i.e., the contention on a single mailbox.
+class SinkProcess : public Process<SinkProcess>
+{
+public:
+  SinkProcess(int _expected, Promise<bool>* _promise)
+    : expected(_expected), received(0), promise(_promise) {}
+
+  void receive()
+  {
+    if (++received == expected) {
+      promise->set(true);
+    }
+  }
+
+private:
+  const int expected;
+  int received;
+  Promise<bool>* promise;
+};
+
+
+struct Producer
+{
+  PID<SinkProcess> pid;
+  int count;
+};
+
+
+void* produce(void* arg)
+{
+  Producer* producer = (Producer*) arg;
+  for (int i = 0; i < producer->count; i++) {
+    dispatch(producer->pid, &SinkProcess::receive);
+  }
+  return NULL;
+}
+
+
+void benchmarkMailbox(int producers, int count)
+{
+  Promise<bool> promise;
+  SinkProcess process(producers * count, &promise);
+  spawn(process);
+
+  Producer producer;
+  producer.pid = process.self();
+  producer.count = count;
+
+  vector<pthread_t> threads(producers);
+
+  double start = Clock::now();
+
+  for (int i = 0; i < producers; i++) {
+    if (pthread_create(&threads[i], NULL, produce, &producer) != 0) {
+      LOG(FATAL) << "Failed to create producer thread";
+    }
+  }
+
+  promise.future().await();
+
+  double elapsed = Clock::now() - start;
+
+  for (int i = 0; i < producers; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  uint64_t dispatches = (uint64_t) producers * count;
+
+  Report("mailbox")
+    .add("producers", producers)
+    .add("dispatches", dispatches)
+    .add("secs", elapsed)
+    .add("dispatches_per_sec", dispatches / elapsed)
+    .print();
+
+  terminate(process);
+  wait(process);
+}
+
+
+void noop() {}
+
+
+void expired(volatile int* remaining, Promise<bool>* promise)
+{
+  if (__sync_sub_and_fetch(remaining, 1) == 0) {
+    promise->set(true);
+  }
+}
+
+
+// Measures the cost of creating and canceling lots of timers (e.g.,
+// a master re-arming ping timeouts for thousands of slaves), as well
+// as how fast lots of (short) timers can be expired.
+void benchmarkTimers(int count)
+{
+  vector<timer> timers;
+  timers.reserve(count);
+
+  double start = Clock::now();
+
+  // Spread the timers out over an hour so that they don't expire.
+  for (int i = 0; i < count; i++) {
+    timers.push_back(timers::create(1 + (i % 3600000) / 1000.0, &noop));
+  }
+
+  double created = Clock::now();
+
+  for (int i = 0; i < count; i++) {
+    timers::cancel(timers[i]);
+  }
+
+  double canceled = Clock::now();
+
+  timers.clear();
+
+  Report("timers")
+    .add("timers", count)
+    .add("creates_per_sec", count / (created - start))
+    .add("cancels_per_sec", count / (canceled - created))
+    .print();
+
+  volatile int remaining = count;
+  Promise<bool> promise;
+
+  std::tr1::function<void(void)> thunk =
+    std::tr1::bind(&expired, &remaining, &promise);
+
+  start = Clock::now();
+
+  // Spread the timers out over 100 milliseconds.
+  for (int i = 0; i < count; i++) {
+    timers::create((i % 100000) / 1000000.0, thunk);
+  }
+
+  promise.future().await();
+
+  double elapsed = Clock::now() - start;
+
+  Report("expirations")
+    .add("timers", count)
+    .add("secs", elapsed)
+    .add("expirations_per_sec", count / elapsed)
+    .print();
+}
+
+
+// Compares the cost of encoding and decoding messages as HTTP
+// requests versus as binary frames (what a sender and a receiver do
+// for every remote message), for a given body size.
+void benchmarkFraming(MessageEncoder::Framing framing, int count, int size)
+{
+  Message message;
+  message.name = "PING";
+  message.from = UPID("slave(1)", 0x0100007f, 5051);
+  message.to = UPID("master", 0x0100007f, 5050);
+  message.body = string(size, 'x');
+
+  DataDecoder decoder;
+
+  if (framing == MessageEncoder::BINARY) {
+    const string& upgrade = MessageEncoder::upgrade(&message);
+    decoder.decode(upgrade.data(), upgrade.size());
+  }
+
+  size_t bytes = 0;
+
+  double start = Clock::now();
+
+  for (int i = 0; i < count; i++) {
+    const string& data = MessageEncoder::encode(&message, framing);
+    bytes += data.size();
+
+    const deque<HttpRequest*>& requests =
+      decoder.decode(data.data(), data.size());
+    const deque<Message*>& messages = decoder.messages();
+
+    CHECK(requests.size() + messages.size() == 1);
+
+    foreach (HttpRequest* request, requests) {
+      delete request;
+    }
+
+    foreach (Message* message, messages) {
+      delete message;
+    }
+  }
+
+  double elapsed = Clock::now() - start;
+
+  Report("framing")
+    .add("framing", framing == MessageEncoder::HTTP ? "http" : "binary")
+    .add("body_bytes", size)
+    .add("bytes_per_message", bytes / count)
+    .add("messages_per_sec", count / elapsed)
+    .print();
+}
+
+
+// Measures the allocations made (and bytes allocated) per message for
+// getting a serialized body (e.g., a protobuf) from a sender into a
+// socket, by copying the body into the message and then into the
+// encoder (what happened before bodies were shared Buffers) versus
+// sharing the body all the way through.
+void benchmarkBodies(bool copy, int count, int size)
+{
+  const uint64_t startAllocations = allocations;
+  const uint64_t startAllocated = allocated;
+
+  size_t bytes = 0;
+
+  double start = Clock::now();
+
+  for (int i = 0; i < count; i++) {
+    // Like ProtobufProcess::send (after serializing).
+    string data(size, 'x');
+
+    Message* message = new Message();
+    message->name = "PING";
+    message->from = UPID("slave(1)", 0x0100007f, 5051);
+    message->to = UPID("master", 0x0100007f, 5050);
+
+    DataEncoder* encoder = NULL;
+
+    if (copy) {
+      message->body = Buffer(data.data(), data.size());
+      encoder = new DataEncoder(MessageEncoder::encode(message));
+      delete message;
+    } else {
+      message->body = Buffer::take(&data);
+      encoder = new MessageEncoder(message);
+    }
+
+    // Like send_data.
+    while (encoder->remaining() > 0) {
+      size_t length;
+      encoder->next(&length);
+      bytes += length;
+    }
+
+    delete encoder;
+  }
+
+  double elapsed = Clock::now() - start;
+
+  Report("bodies")
+    .add("bodies", copy ? "copied" : "shared")
+    .add("body_bytes", size)
+    .add("allocations_per_message",
+         (double) (allocations - startAllocations) / count)
+    .add("bytes_allocated_per_message",
+         (double) (allocated - startAllocated) / count)
+    .add("messages_per_sec", count / elapsed)
+    .print();
+
+  CHECK(bytes > (size_t) count * size);
+}
+
+
+// Measures the latency of remote messages (from being written to a
+// socket until being handled by the receiving process) depending on
+// how many connections are sending messages at the same time. Each
+// round writes one message to every connection and waits until all
+// of them have been received (try with a varying number of
+// LIBPROCESS_IO_THREADS).
+class LatencyProcess : public Process<LatencyProcess>
+{
+public:
+  LatencyProcess() : received(0), total(0), worst(0)
+  {
+    install("PING", &LatencyProcess::ping);
+  }
+
+  void ping(const UPID& from, const string& body)
+  {
+    double sent;
+    CHECK(body.size() == sizeof(sent));
+    memcpy(&sent, body.data(), sizeof(sent));
+
+    double latency = Clock::now() - sent;
+    total += latency;
+    worst = std::max(worst, latency);
+
+    __sync_synchronize();
+    received++;
+  }
+
+  volatile int received;
+  double total;
+  double worst;
+};
+
+
+void benchmarkConnections(int connections, int count)
+{
+  LatencyProcess process;
+  spawn(process);
+
+  const UPID& pid = process.self();
+
+  vector<int> sockets;
+
+  for (int i = 0; i < connections; i++) {
+    int s = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    CHECK(s >= 0);
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = PF_INET;
+    addr.sin_port = htons(pid.port);
+    addr.sin_addr.s_addr = pid.ip;
+
+    CHECK(connect(s, (sockaddr*) &addr, sizeof(addr)) == 0);
+
+    sockets.push_back(s);
+  }
+
+  Message message;
+  message.name = "PING";
+  message.from = UPID("benchmark", pid.ip, pid.port);
+  message.to = pid;
+
+  int rounds = count / connections;
+
+  for (int round = 0; round < rounds; round++) {
+    foreach (int s, sockets) {
+      double now = Clock::now();
+      message.body = Buffer((const char*) &now, sizeof(now));
+      const string& data = MessageEncoder::encode(&message);
+      CHECK(write(s, data.data(), data.size()) == (ssize_t) data.size());
+    }
+
+    while (process.received < (round + 1) * connections) {
+      sched_yield();
+    }
+  }
+
+  __sync_synchronize();
+
+  int received = process.received;
+
+  Report("connections")
+    .add("connections", connections)
+    .add("mean_usecs", process.total / received * 1000000)
+    .add("max_usecs", process.worst * 1000000)
+    .print();
+
+  foreach (int s, sockets) {
+    close(s);
+  }
+
+  terminate(process);
+  wait(process);
+}
+
+
+// Measures the round-trip latency of remote messages over loopback:
+// the benchmark acts as a remote process that sends a PING over a
+// socket and waits for the PONG, which gets sent back over another
+// socket just like to any other remote process.
+class PongProcess : public Process<PongProcess>
+{
+public:
+  PongProcess()
+  {
+    install("PING", &PongProcess::ping);
+  }
+
+  void ping(const UPID& from, const string& body)
+  {
+    send(from, "PONG", body.data(), body.size());
+  }
+};
+
+
+void benchmarkPingPong(int count, int size)
+{
+  PongProcess process;
+  spawn(process);
+
+  const UPID& pid = process.self();
+
+  // Listen for the connection(s) the PONGs get sent on.
+  int listener = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+  CHECK(listener >= 0);
+
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = PF_INET;
+  addr.sin_port = 0;
+  addr.sin_addr.s_addr = pid.ip;
+
+  socklen_t addrlen = sizeof(addr);
+
+  CHECK(bind(listener, (sockaddr*) &addr, sizeof(addr)) == 0);
+  CHECK(listen(listener, 16) == 0);
+  CHECK(getsockname(listener, (sockaddr*) &addr, &addrlen) == 0);
+
+  Message message;
+  message.name = "PING";
+  message.from = UPID("benchmark", pid.ip, ntohs(addr.sin_port));
+  message.to = pid;
+  message.body = string(size, 'x');
+
+  const string& data = MessageEncoder::encode(&message);
+
+  int s = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+  CHECK(s >= 0);
+
+  addr.sin_port = htons(pid.port);
+  addr.sin_addr.s_addr = pid.ip;
+
+  CHECK(connect(s, (sockaddr*) &addr, sizeof(addr)) == 0);
+
+  // Incoming connections (and their decoders).
+  map<int, DataDecoder*> decoders;
+
+  vector<double> latencies;
+  latencies.reserve(count);
+
+  char buffer[64 * 1024];
+
+  double start = Clock::now();
+
+  for (int i = 0; i < count; i++) {
+    double sent = Clock::now();
+
+    CHECK(write(s, data.data(), data.size()) == (ssize_t) data.size());
+
+    int received = 0;
+
+    while (received == 0) {
+      vector<pollfd> fds;
+
+      pollfd fd;
+      fd.fd = listener;
+      fd.events = POLLIN;
+      fds.push_back(fd);
+
+      foreachkey (int c, decoders) {
+        fd.fd = c;
+        fds.push_back(fd);
+      }
+
+      CHECK(poll(&fds[0], fds.size(), 5000) > 0)
+        << "Timed out waiting for a PONG";
+
+      foreach (const pollfd& fd, fds) {
+        if ((fd.revents & (POLLIN | POLLHUP | POLLERR)) == 0) {
+          continue;
+        } else if (fd.fd == listener) {
+          int c = accept(listener, NULL, NULL);
+          CHECK(c >= 0);
+          decoders[c] = new DataDecoder();
+          continue;
+        }
+
+        ssize_t length = read(fd.fd, buffer, sizeof(buffer));
+
+        if (length <= 0) {
+          close(fd.fd);
+          delete decoders[fd.fd];
+          decoders.erase(fd.fd);
+          continue;
+        }
+
+        DataDecoder* decoder = decoders[fd.fd];
+
+        const deque<HttpRequest*>& requests = decoder->decode(buffer, length);
+        const deque<Message*>& messages = decoder->messages();
+
+        received += requests.size() + messages.size();
+
+        foreach (HttpRequest* request, requests) {
+          delete request;
+        }
+
+        foreach (Message* message, messages) {
+          delete message;
+        }
+      }
+    }
+
+    CHECK(received == 1);
+
+    latencies.push_back(Clock::now() - sent);
+  }
+
+  double elapsed = Clock::now() - start;
+
+  Report report("pingpong");
+  report.add("body_bytes", size)
+    .add("round_trips", count)
+    .add("round_trips_per_sec", count / elapsed);
+  percentiles(&report, latencies);
+  report.print();
+
+  close(s);
+  close(listener);
+
+  foreachpair (int c, DataDecoder* decoder, decoders) {
+    close(c);
+    delete decoder;
+  }
+
+  terminate(process);
+  wait(process);
+}
+
+
+// Measures message passing between a coordinator and many workers
+// (e.g., a master and the slaves it sends tasks to): each round the
+// coordinator sends a message to every worker (fan-out) and waits for
+// all of them to reply (fan-in) before starting the next round.
+class WorkerProcess : public Process<WorkerProcess>
+{
+public:
+  WorkerProcess()
+  {
+    install("WORK", &WorkerProcess::work);
+  }
+
+  void work(const UPID& from, const string& body)
+  {
+    send(from, "DONE");
+  }
+};
+
+
+class CoordinatorProcess : public Process<CoordinatorProcess>
+{
+public:
+  CoordinatorProcess(const vector<UPID>& _workers,
+                     int _rounds,
+                     Promise<bool>* _promise)
+    : workers(_workers), rounds(_rounds), pending(0), promise(_promise)
+  {
+    install("DONE", &CoordinatorProcess::done);
+  }
+
+  virtual void initialize()
+  {
+    round();
+  }
+
+  void round()
+  {
+    foreach (const UPID& worker, workers) {
+      send(worker, "WORK");
+    }
+    pending = workers.size();
+  }
+
+  void done(const UPID& from, const string& body)
+  {
+    if (--pending == 0) {
+      if (--rounds == 0) {
+        promise->set(true);
+      } else {
+        round();
+      }
+    }
+  }
+
+private:
+  const vector<UPID> workers;
+  int rounds;
+  size_t pending;
+  Promise<bool>* promise;
+};
+
+
+void benchmarkFanOut(int workers, int count)
+{
+  vector<WorkerProcess*> processes;
+  vector<UPID> pids;
+
+  for (int i = 0; i < workers; i++) {
+    WorkerProcess* process = new WorkerProcess();
+    pids.push_back(spawn(process));
+    processes.push_back(process);
+  }
+
+  // Every round sends (and receives) 2 messages per worker.
+  int rounds = std::max(1, count / workers);
+
+  Promise<bool> promise;
+  CoordinatorProcess coordinator(pids, rounds, &promise);
+
+  double start = Clock::now();
+
+  spawn(coordinator);
+
+  promise.future().await();
+
+  double elapsed = Clock::now() - start;
+
+  uint64_t messages = (uint64_t) rounds * workers * 2;
+
+  Report("fanout")
+    .add("workers", workers)
+    .add("rounds", rounds)
+    .add("messages", messages)
+    .add("messages_per_sec", messages / elapsed)
+    .add("usecs_per_round", elapsed / rounds * 1000000)
+    .print();
+
+  terminate(coordinator);
+  wait(coordinator);
+
+  foreach (WorkerProcess* process, processes) {
+    terminate(process);
+    wait(process);
+    delete process;
+  }
+}
+
+
+void chain(Promise<int>* promise, const int& i)
+{
+  promise->set(i + 1);
+}
+
+
+// Measures the overhead of futures: creating promises and chaining
+// them with callbacks (like a sequence of continuations), and then
+// how long it takes to get a value through the entire chain.
+void benchmarkFutures(int length, int count)
+{
+  double created = 0;
+  double completed = 0;
+
+  for (int i = 0; i < count; i++) {
+    vector<Promise<int>*> promises(length);
+
+    double start = Clock::now();
+
+    for (int j = 0; j < length; j++) {
+      promises[j] = new Promise<int>();
+    }
+
+    for (int j = 0; j < length - 1; j++) {
+      promises[j]->future()
+        .onReady(std::tr1::bind(&chain,
+                                promises[j + 1],
+                                std::tr1::placeholders::_1));
+    }
+
+    double chained = Clock::now();
+
+    promises[0]->set(0);
+
+    CHECK(promises[length - 1]->future().get() == length - 1);
+
+    double done = Clock::now();
+
+    created += chained - start;
+    completed += done - chained;
+
+    foreach (Promise<int>* promise, promises) {
+      delete promise;
+    }
+  }
+
+  double futures = (double) length * count;
+
+  Report("futures")
+    .add("length", length)
+    .add("chains", count)
+    .add("nsecs_per_link_created", created / futures * 1000000000)
+    .add("nsecs_per_link_completed", completed / futures * 1000000000)
+    .print();
+}
+
+
+// Measures how fast processes can be spawned and then terminated
+// (e.g., the short lived processes used for collecting futures or
+// for reaping a child).
+class EmptyProcess : public Process<EmptyProcess> {};
+
+
+void benchmarkSpawn(int count)
+{
+  vector<EmptyProcess*> processes;
+  processes.reserve(count);
+
+  for (int i = 0; i < count; i++) {
+    processes.push_back(new EmptyProcess());
+  }
+
+  double start = Clock::now();
+
+  foreach (EmptyProcess* process, processes) {
+    spawn(process);
+  }
+
+  double spawned = Clock::now();
+
+  foreach (EmptyProcess* process, processes) {
+    terminate(process);
+  }
+
+  foreach (EmptyProcess* process, processes) {
+    wait(process);
+  }
+
+  double terminated = Clock::now();
+
+  foreach (EmptyProcess* process, processes) {
+    delete process;
+  }
+
+  Report("spawn")
+    .add("processes", count)
+    .add("spawns_per_sec", count / (spawned - start))
+    .add("terminates_per_sec", count / (terminated - spawned))
+    .print();
+}
+
+
+// Usage: benchmarks [count] [benchmark ...]
+//
+// Runs all of the benchmarks unless some are named, using 'count' to
+// scale the number of iterations (default 10000).
+int main(int argc, char** argv)
+{
+  int count = argc > 1 ? atoi(argv[1]) : 10000;
+
+  CHECK(count > 0) << "Usage: " << argv[0] << " [count] [benchmark ...]";
+
+  const set<string> benchmarks(argv + std::min(argc, 2), argv + argc);
+
+#define BENCHMARK(name) (benchmarks.empty() || benchmarks.count(name) > 0)
+
+  process::initialize();
+
+  Report("configuration")
+    .add("count", count)
+    .add("cpus", sysconf(_SC_NPROCESSORS_ONLN))
+    .print();
+
+  if (BENCHMARK("roundtrip")) {
+    benchmarkRoundTrip(count);
+  }
+
+  if (BENCHMARK("results")) {
+    benchmarkResults(count * 10);
+  }
+
+  if (BENCHMARK("allocations")) {
+    benchmarkAllocations(count);
+  }
+
+  if (BENCHMARK("dispatch")) {
+    for (int pairs = 1; pairs <= 64; pairs *= 2) {
+      benchmarkDispatch(pairs, count);
+    }
+  }
+
+  if (BENCHMARK("mailbox")) {
+    for (int producers = 1; producers <= 16; producers *= 2) {
+      benchmarkMailbox(producers, count * 10);
+    }
+  }
+
+  if (BENCHMARK("fanout")) {
+    for (int workers = 1; workers <= 1024; workers *= 8) {
+      benchmarkFanOut(workers, count * 10);
+    }
+  }
+
+  if (BENCHMARK("futures")) {
+    for (int length = 1; length <= 1000; length *= 10) {
+      benchmarkFutures(length, std::max(1, count * 10 / length));
+    }
+  }
+
+  if (BENCHMARK("spawn")) {
+    benchmarkSpawn(count);
+  }
+
+  if (BENCHMARK("timers")) {
+    benchmarkTimers(count * 100);
+  }
+
+  if (BENCHMARK("framing")) {
+    for (int size = 0; size <= 4096; size = size == 0 ? 64 : size * 8) {
+      benchmarkFraming(MessageEncoder::HTTP, count * 10, size);
+      benchmarkFraming(MessageEncoder::BINARY, count * 10, size);
+    }
+  }
+
+  if (BENCHMARK("bodies")) {
+    for (int size = 64; size <= 1024 * 1024; size *= 16) {
+      benchmarkBodies(true, count, size);
+      benchmarkBodies(false, count, size);
+    }
+  }
+
+  if (BENCHMARK("pingpong")) {
+    for (int size = 64; size <= 64 * 1024; size *= 32) {
+      benchmarkPingPong(count, size);
+    }
+  }
+
+  if (BENCHMARK("connections")) {
+    for (int connections = 1; connections <= 256; connections *= 4) {
+      benchmarkConnections(connections, count * 4);
+    }
+  }
+
+#undef BENCHMARK
+
+  return 0;
+}
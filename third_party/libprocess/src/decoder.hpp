@@ -2,23 +2,54 @@
 #define __DECODER_HPP__
 
 #include <http_parser.h>
+#include <stdint.h>
 
+#include <algorithm>
 #include <deque>
 #include <string>
 #include <vector>
 
 #include <process/http.hpp>
+#include <process/message.hpp>
 
 #include "foreach.hpp"
+#include "frame.hpp"
 
 
 namespace process {
 
+// Decodes HTTP requests and, once the connection has been upgraded
+// (see frame.hpp), binary framed messages.
 class DataDecoder
 {
 public:
+  // Statistics about what a decoder has decoded (e.g., for reporting
+  // per connection statistics).
+  struct Statistics
+  {
+    Statistics()
+      : reads(0), bytes(0), requests(0), messages(0), buffered(0) {}
+
+    Statistics& operator += (const Statistics& that)
+    {
+      reads += that.reads;
+      bytes += that.bytes;
+      requests += that.requests;
+      messages += that.messages;
+      buffered += that.buffered;
+      return *this;
+    }
+
+    uint64_t reads; // Calls to 'decode'.
+    uint64_t bytes;
+    uint64_t requests; // HTTP requests.
+    uint64_t messages; // Messages from binary frames.
+    uint64_t buffered; // Bytes of partial frame headers that got buffered.
+  };
+
   DataDecoder()
-    : failure(false), request(NULL)
+    : failure(false), upgraded(false), request(NULL),
+      message(NULL), remaining(0)
   {
     settings.on_message_begin = &DataDecoder::on_message_begin;
     settings.on_header_field = &DataDecoder::on_header_field;
@@ -36,11 +67,46 @@ public:
     parser.data = this;
   }
 
+  ~DataDecoder()
+  {
+    delete message;
+  }
+
   std::deque<HttpRequest*> decode(const char* data, size_t length)
   {
+    stats.reads++;
+    stats.bytes += length;
+
+    if (upgraded) {
+      frames(data, length);
+      return std::deque<HttpRequest*>();
+    }
+
     size_t parsed = http_parser_execute(&parser, &settings, data, length);
 
-    if (parsed != length) {
+    if (parser.upgrade) {
+      // The last request is the upgrade request, the rest of the data
+      // (if any) is binary frames.
+      assert(!requests.empty());
+      HttpRequest* upgrade = requests.back();
+      requests.pop_back();
+
+      if (upgrade->headers["Upgrade"] != frame::PROTOCOL) {
+        failure = true;
+      } else {
+        upgraded = true;
+
+        // Some versions of the parser don't consume the final line
+        // feed of the upgrade request.
+        if (parsed < length && data[parsed] == '\n') {
+          parsed++;
+        }
+
+        frames(data + parsed, length - parsed);
+      }
+
+      delete upgrade;
+    } else if (parsed != length) {
       failure = true;
     }
 
@@ -53,12 +119,153 @@ public:
     return std::deque<HttpRequest*>();
   }
 
+  // Returns the messages decoded from binary frames since the last
+  // call (the caller takes ownership). Note that only the id of the
+  // receiver is set, the caller needs to fill in its ip and port.
+  std::deque<Message*> messages()
+  {
+    if (!decoded.empty()) {
+      std::deque<Message*> result = decoded;
+      decoded.clear();
+      return result;
+    }
+
+    return std::deque<Message*>();
+  }
+
   bool failed() const
   {
     return failure;
   }
 
+  const Statistics& statistics() const
+  {
+    return stats;
+  }
+
 private:
+  // Decodes as many binary frames as possible. Only the header of a
+  // frame (up to the body) ever gets buffered; the bytes of a body
+  // get copied straight into the body of its message, even when the
+  // body arrives in many pieces, and are then handed off to the
+  // message without copying them again.
+  void frames(const char* data, size_t length)
+  {
+    while (!failure && length > 0) {
+      if (message != NULL) {
+        const size_t size = std::min(length, remaining);
+        body.append(data, size);
+        data += size;
+        length -= size;
+        remaining -= size;
+        if (remaining == 0) {
+          finish();
+        }
+      } else if (buffer.empty() && length >= needed(data, length)) {
+        // The whole header is here, no need to buffer it.
+        const size_t size = needed(data, length);
+        if (!failure) {
+          begin(data);
+          data += size;
+          length -= size;
+        }
+      } else {
+        // Buffer (the rest of) the header until all of it arrived,
+        // without taking any of the bytes that come after it.
+        const size_t size = std::min(
+            length, needed(buffer.data(), buffer.size()) - buffer.size());
+        buffer.append(data, size);
+        data += size;
+        length -= size;
+        stats.buffered += size;
+        if (!failure &&
+            buffer.size() == needed(buffer.data(), buffer.size())) {
+          begin(buffer.data());
+          buffer.clear();
+        }
+      }
+    }
+  }
+
+  // Returns the size of the header of the frame starting at 'data'
+  // as far as that can be determined from 'length' bytes (i.e., at
+  // least frame::HEADER_SIZE). Fails the decoder if the frame has the
+  // wrong version or exceeds frame::MAX_HEADER_SIZE or
+  // frame::MAX_BODY_SIZE.
+  size_t needed(const char* data, size_t length)
+  {
+    if (length < frame::HEADER_SIZE) {
+      return frame::HEADER_SIZE;
+    }
+
+    if ((uint8_t) data[0] != frame::VERSION) {
+      failure = true;
+      return frame::HEADER_SIZE;
+    }
+
+    uint32_t sizes[4]; // From id, to id, name and body.
+    const char* header = data + 1 + 4 + 2;
+    for (int i = 0; i < 4; i++) {
+      header = frame::read(header, &sizes[i]);
+    }
+
+    // Summed in 64 bits since each size can be up to 4 GB.
+    const uint64_t size =
+      (uint64_t) frame::HEADER_SIZE + sizes[0] + sizes[1] + sizes[2];
+
+    if (size > frame::MAX_HEADER_SIZE || sizes[3] > frame::MAX_BODY_SIZE) {
+      failure = true;
+      return frame::HEADER_SIZE;
+    }
+
+    return (size_t) size;
+  }
+
+  // Starts a message from the (complete) header of a frame.
+  void begin(const char* header)
+  {
+    assert(message == NULL);
+
+    uint32_t ip;
+    uint16_t port;
+    uint32_t sizes[4]; // From id, to id, name and body.
+
+    header++; // Version.
+    header = frame::read(header, &ip);
+    header = frame::read(header, &port);
+
+    for (int i = 0; i < 4; i++) {
+      header = frame::read(header, &sizes[i]);
+    }
+
+    message = new Message();
+    message->from.ip = ip;
+    message->from.port = port;
+    message->from.id.assign(header, sizes[0]);
+    header += sizes[0];
+    message->to.id.assign(header, sizes[1]);
+    header += sizes[1];
+    message->name.assign(header, sizes[2]);
+
+    remaining = sizes[3];
+
+    if (remaining == 0) {
+      finish();
+    } else {
+      body.clear();
+      body.reserve(std::min(remaining, frame::RESERVE_SIZE));
+    }
+  }
+
+  // Hands the body off to the message and the message to 'decoded'.
+  void finish()
+  {
+    message->body = Buffer::take(&body);
+    decoded.push_back(message);
+    message = NULL;
+    stats.messages++;
+  }
+
   static int on_message_begin(http_parser* p)
   {
     DataDecoder* decoder = (DataDecoder*) p->data;
@@ -98,6 +305,7 @@ private:
 //     std::cout << "  path: " << decoder->request->path << std::endl;
     decoder->requests.push_back(decoder->request);
     decoder->request = NULL;
+    decoder->stats.requests++;
     return 0;
   }
 
@@ -107,7 +315,7 @@ private:
     assert(decoder->request != NULL);
 
     if (decoder->header != HEADER_FIELD) {
-      decoder->request->headers[decoder->field] = decoder->value;
+      decoder->request->headers[decoder->field].swap(decoder->value);
       decoder->field.clear();
       decoder->value.clear();
     }
@@ -168,6 +376,7 @@ private:
   }
 
   bool failure;
+  bool upgraded;
 
   http_parser parser;
   http_parser_settings settings;
@@ -183,6 +392,16 @@ private:
   HttpRequest* request;
 
   std::deque<HttpRequest*> requests;
+
+  // Partial header of a binary frame, the message (and its body)
+  // currently being decoded, and the messages decoded so far.
+  std::string buffer;
+  Message* message;
+  std::string body;
+  size_t remaining; // Bytes of the body still to come.
+  std::deque<Message*> decoded;
+
+  Statistics stats;
 };
 
 }  // namespace process {
@@ -6,24 +6,47 @@
 #include <process/process.hpp>
 
 #include "foreach.hpp"
+#include "frame.hpp"
 
 
 namespace process {
 
+// Encodes data as (up to) three parts: a head, a body and a tail. The
+// body is a Buffer so that it can be shared with the message it came
+// from rather than copied. Each call to 'next' returns (the rest of)
+// the current part, so callers keep calling it until 'remaining'
+// returns 0.
 class DataEncoder
 {
 public:
-  DataEncoder(const std::string& _data)
-    : data(_data), index(0) {}
+  static const size_t MAX_PARTS = 3;
+
+  DataEncoder(const std::string& _head,
+              const Buffer& _body = Buffer(),
+              const std::string& _tail = std::string())
+    : head(_head), body(_body), tail(_tail), index(0) {}
 
   virtual ~DataEncoder() {}
 
   const char* next(size_t* length)
   {
-    size_t temp = index;
-    index = data.size();
-    *length = data.size() - temp;
-    return data.data() + temp;
+    const char* data;
+    size_t offset = index;
+
+    if (offset < head.size()) {
+      data = head.data() + offset;
+      *length = head.size() - offset;
+    } else if ((offset -= head.size()) < body.size()) {
+      data = body.data() + offset;
+      *length = body.size() - offset;
+    } else {
+      offset -= body.size();
+      data = tail.data() + offset;
+      *length = tail.size() - offset;
+    }
+
+    index += *length;
+    return data;
   }
 
   void backup(size_t length)
@@ -35,11 +58,18 @@ public:
 
   size_t remaining() const
   {
-    return data.size() - index;
+    return size() - index;
+  }
+
+  size_t size() const
+  {
+    return head.size() + body.size() + tail.size();
   }
 
 private:
-  const std::string data;
+  const std::string head;
+  const Buffer body;
+  const std::string tail;
   size_t index;
 };
 
@@ -47,8 +77,22 @@ private:
 class MessageEncoder : public DataEncoder
 {
 public:
-  MessageEncoder(Message* _message)
-    : DataEncoder(encode(_message)), message(_message) {}
+  // How a message gets encoded on a connection: as an HTTP request,
+  // as a binary frame (see frame.hpp), or as an HTTP upgrade request
+  // followed by a binary frame for the first message of a connection
+  // that switches to binary frames.
+  enum Framing {
+    HTTP,
+    UPGRADE,
+    BINARY
+  };
+
+  // Note that the body of the message is shared, not copied.
+  MessageEncoder(Message* _message, Framing framing = HTTP)
+    : DataEncoder(head(_message, framing),
+                  _message != NULL ? _message->body : Buffer(),
+                  tail(_message, framing)),
+      message(_message) {}
 
   virtual ~MessageEncoder()
   {
@@ -57,32 +101,98 @@ public:
     }
   }
 
-  static std::string encode(Message* message)
+  static std::string encode(Message* message, Framing framing = HTTP)
   {
     if (message != NULL) {
-      std::ostringstream out;
-
-      out << "POST /" << message->to.id << "/" << message->name
-          << " HTTP/1.0\r\n"
-          << "User-Agent: libprocess/" << message->from << "\r\n"
-          << "Connection: Keep-Alive\r\n";
-
-      if (message->body.size() > 0) {
-        out << "Transfer-Encoding: chunked\r\n\r\n"
-            << std::hex << message->body.size() << "\r\n";
-        out.write(message->body.data(), message->body.size());
-        out << "\r\n"
-            << "0\r\n"
-            << "\r\n";
-      } else {
-        out << "\r\n";
-      }
-
-      return out.str();
+      return head(message, framing) + message->body.str() +
+        tail(message, framing);
     }
+
+    return std::string();
+  }
+
+  // Returns the HTTP request which switches a connection over to
+  // binary frames (it does not get delivered to any process).
+  static std::string upgrade(Message* message)
+  {
+    std::ostringstream out;
+
+    out << "POST /" << message->to.id << " HTTP/1.1\r\n"
+        << "User-Agent: libprocess/" << message->from << "\r\n"
+        << "Upgrade: " << frame::PROTOCOL << "\r\n"
+        << "Connection: Upgrade\r\n"
+        << "\r\n";
+
+    return out.str();
   }
 
 private:
+  // Returns everything that goes before the body of the message.
+  static std::string head(Message* message, Framing framing)
+  {
+    if (message == NULL) {
+      return std::string();
+    } else if (framing == BINARY) {
+      return frame(message);
+    } else if (framing == UPGRADE) {
+      return upgrade(message) + frame(message);
+    }
+
+    std::ostringstream out;
+
+    out << "POST /" << message->to.id << "/" << message->name
+        << " HTTP/1.0\r\n"
+        << "User-Agent: libprocess/" << message->from << "\r\n"
+        << frame::ADVERTISEMENT << ": " << frame::BINARY << "\r\n"
+        << "Connection: Keep-Alive\r\n";
+
+    if (message->body.size() > 0) {
+      out << "Transfer-Encoding: chunked\r\n\r\n"
+          << std::hex << message->body.size() << "\r\n";
+    } else {
+      out << "\r\n";
+    }
+
+    return out.str();
+  }
+
+  // Returns everything that goes after the body of the message.
+  static std::string tail(Message* message, Framing framing)
+  {
+    if (message != NULL && framing == HTTP && message->body.size() > 0) {
+      return "\r\n0\r\n\r\n";
+    }
+
+    return std::string();
+  }
+
+  // Returns the header of the binary frame for the message, i.e.,
+  // the frame up to the body.
+  static std::string frame(Message* message)
+  {
+    const std::string& from = message->from.id;
+    const std::string& to = message->to.id;
+    const std::string& name = message->name;
+
+    std::string data(frame::HEADER_SIZE, '\0');
+    data.reserve(frame::HEADER_SIZE + from.size() + to.size() + name.size());
+
+    char* header = &data[0];
+    *header++ = frame::VERSION;
+    header = frame::write(header, message->from.ip);
+    header = frame::write(header, message->from.port);
+    header = frame::write(header, (uint32_t) from.size());
+    header = frame::write(header, (uint32_t) to.size());
+    header = frame::write(header, (uint32_t) name.size());
+    header = frame::write(header, (uint32_t) message->body.size());
+
+    data.append(from);
+    data.append(to);
+    data.append(name);
+
+    return data;
+  }
+
   Message* message;
 };
 
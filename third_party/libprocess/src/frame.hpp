@@ -0,0 +1,89 @@
+#ifndef __FRAME_HPP__
+#define __FRAME_HPP__
+
+#include <stdint.h>
+#include <string.h>
+
+#include <arpa/inet.h>
+
+namespace process {
+
+// Binary framing of libprocess messages. A connection always starts
+// out speaking HTTP and gets switched to binary frames via an HTTP
+// upgrade request (see MessageEncoder). A sender only does that for
+// peers that advertised that they understand binary frames (via the
+// 'ADVERTISEMENT' header on their own HTTP messages), so that older
+// peers and other HTTP clients keep working.
+//
+// Each frame consists of a fixed size header followed by the id of
+// the sender, the id of the receiver, the message name and the
+// message body. All integers are in network byte order:
+//
+//   uint8  version
+//   uint32 ip of the sender       uint16 port of the sender
+//   uint32 size of the sender id  uint32 size of the receiver id
+//   uint32 size of the name       uint32 size of the body
+//
+// Like with HTTP, the ip and port of the receiver are implied by the
+// connection the frame was received on.
+namespace frame {
+
+const uint8_t VERSION = 1;
+
+const size_t HEADER_SIZE = 1 + 4 + 2 + 4 * 4;
+
+// Largest header (including the ids and the name) and body of a frame
+// that get accepted, so that a peer can't make a receiver allocate
+// arbitrary amounts of memory. Ids and names are short and bodies are
+// (usually) protocol buffers, which can't be parsed beyond 64 MB.
+const size_t MAX_HEADER_SIZE = 64 * 1024;
+const size_t MAX_BODY_SIZE = 64 * 1024 * 1024;
+
+// Most of the body that gets reserved before it has arrived, the rest
+// gets allocated as the bytes of the body come in.
+const size_t RESERVE_SIZE = 64 * 1024;
+
+// Value of the HTTP 'Upgrade' header used to switch to binary frames.
+const char* const PROTOCOL = "libprocess/1";
+
+// HTTP header (and value) libprocess messages get sent with to
+// advertise that binary frames are understood.
+const char* const ADVERTISEMENT = "Libprocess-Framing";
+const char* const BINARY = "binary";
+
+
+inline char* write(char* data, uint16_t value)
+{
+  value = htons(value);
+  memcpy(data, &value, sizeof(value));
+  return data + sizeof(value);
+}
+
+
+inline char* write(char* data, uint32_t value)
+{
+  value = htonl(value);
+  memcpy(data, &value, sizeof(value));
+  return data + sizeof(value);
+}
+
+
+inline const char* read(const char* data, uint16_t* value)
+{
+  memcpy(value, data, sizeof(*value));
+  *value = ntohs(*value);
+  return data + sizeof(*value);
+}
+
+
+inline const char* read(const char* data, uint32_t* value)
+{
+  memcpy(value, data, sizeof(*value));
+  *value = ntohl(*value);
+  return data + sizeof(*value);
+}
+
+} // namespace frame {
+} // namespace process {
+
+#endif // __FRAME_HPP__
@@ -1,10 +1,14 @@
 #include <errno.h>
 #include <netdb.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <arpa/inet.h>
 
+#include <sys/time.h>
+
 #include <glog/logging.h>
 
 #include <iostream>
@@ -12,6 +16,8 @@
 
 #include <boost/unordered_map.hpp>
 
+#include <process/dispatch.hpp>
+#include <process/dns.hpp>
 #include <process/pid.hpp>
 #include <process/process.hpp>
 
@@ -118,6 +124,35 @@ istream& operator >> (istream& stream, UPID& pid)
     return stream;
   }
 
+  Option<uint32_t> address = dns::resolve(host);
+
+  if (address.isNone()) {
+    stream.setstate(std::ios_base::badbit);
+    return stream;
+  }
+
+  ip = address.get();
+
+  str = str.substr(index + 1);
+
+  if (sscanf(str.c_str(), "%hu", &port) != 1) {
+    stream.setstate(std::ios_base::badbit);
+    return stream;
+  }
+
+  pid.id = id;
+  pid.ip = ip;
+  pid.port = port;
+
+  return stream;
+}
+
+
+namespace dns {
+
+// Looks up the hostname (without using the cache).
+static Option<uint32_t> gethostbyname(const string& hostname)
+{
   hostent he, *hep;
   char* temp;
   size_t length;
@@ -128,7 +163,7 @@ istream& operator >> (istream& stream, UPID& pid)
   length = 1024;
   temp = new char[length];
 
-  while ((result = gethostbyname2_r(host.c_str(), AF_INET, &he,
+  while ((result = gethostbyname2_r(hostname.c_str(), AF_INET, &he,
 				    temp, length, &hep, &herrno)) == ERANGE) {
     // Enlarge the buffer.
     delete[] temp;
@@ -137,39 +172,221 @@ istream& operator >> (istream& stream, UPID& pid)
   }
 
   if (result != 0 || hep == NULL) {
-    VLOG(2) << "Failed to parse host '" << host
+    VLOG(2) << "Failed to parse host '" << hostname
 	    << "' because " << hstrerror(herrno);
     delete[] temp;
-    stream.setstate(std::ios_base::badbit);
-    return stream;
+    return Option<uint32_t>::none();
   }
 
   if (hep->h_addr_list[0] == NULL) {
-    VLOG(2) << "Got no addresses for '" << host << "'";
+    VLOG(2) << "Got no addresses for '" << hostname << "'";
     delete[] temp;
-    stream.setstate(std::ios_base::badbit);
-    return stream;
+    return Option<uint32_t>::none();
   }
 
-  ip = *((uint32_t*) hep->h_addr_list[0]);
+  uint32_t ip = *((uint32_t*) hep->h_addr_list[0]);
 
   delete[] temp;
 
-  str = str.substr(index + 1);
+  return ip;
+}
 
-  if (sscanf(str.c_str(), "%hu", &port) != 1) {
-    stream.setstate(std::ios_base::badbit);
-    return stream;
+
+// A cached address and when it expires (in seconds since the epoch).
+struct Entry
+{
+  uint32_t ip;
+  double expires;
+};
+
+
+// The cache, which is protected by a spinlock (rather than a
+// synchronizable) so that UPIDs can be parsed during static
+// initialization. The cache gets allocated (and LIBPROCESS_DNS_TTL
+// gets read) the first time it is used.
+static boost::unordered_map<string, Entry>* entries = NULL;
+static double ttl = 60;
+static int lock = 0;
+
+static Statistics counters = { 0, 0, 0, 0 };
+
+// Caching too many hostnames most likely means that something is
+// resolving arbitrary names, so we just start over at that point.
+static const size_t MAX_ENTRIES = 4096;
+
+
+static double now()
+{
+  timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+
+static void acquire()
+{
+  while (__sync_lock_test_and_set(&lock, 1) != 0) {
+    asm ("pause");
   }
 
-  pid.id = id;
-  pid.ip = ip;
-  pid.port = port;
+  if (entries == NULL) {
+    entries = new boost::unordered_map<string, Entry>();
+
+    const char* value = getenv("LIBPROCESS_DNS_TTL");
+    if (value != NULL) {
+      ttl = atof(value);
+      if (ttl < 0) {
+        LOG(FATAL) << "LIBPROCESS_DNS_TTL=" << value
+                   << " is not a valid number of seconds";
+      }
+    }
+  }
+}
 
-  return stream;
+
+static void release()
+{
+  __sync_lock_release(&lock);
 }
 
 
+Option<uint32_t> resolve(const string& hostname)
+{
+  // Dotted quads (e.g., from the output of a UPID) don't need a
+  // lookup at all.
+  in_addr addr;
+  if (inet_pton(AF_INET, hostname.c_str(), &addr) == 1) {
+    return addr.s_addr;
+  }
+
+  acquire();
+
+  boost::unordered_map<string, Entry>::iterator iterator =
+    entries->find(hostname);
+
+  if (iterator != entries->end() && iterator->second.expires > now()) {
+    counters.hits++;
+    const uint32_t ip = iterator->second.ip;
+    release();
+    return ip;
+  }
+
+  counters.misses++;
+
+  release();
+
+  // Do the lookup without holding the lock (multiple threads might
+  // end up looking up the same hostname at the same time, the last
+  // one to finish updates the cache).
+  Option<uint32_t> ip = gethostbyname(hostname);
+
+  acquire();
+
+  if (ip.isNone()) {
+    counters.failures++;
+    entries->erase(hostname);
+  } else if (ttl > 0) {
+    if (entries->size() >= MAX_ENTRIES) {
+      entries->clear();
+    }
+
+    Entry entry;
+    entry.ip = ip.get();
+    entry.expires = now() + ttl;
+    (*entries)[hostname] = entry;
+  }
+
+  release();
+
+  return ip;
+}
+
+
+// Returns the address of the hostname if it is a dotted quad or
+// cached (and not expired), without blocking.
+static Option<uint32_t> cached(const string& hostname)
+{
+  in_addr addr;
+  if (inet_pton(AF_INET, hostname.c_str(), &addr) == 1) {
+    return addr.s_addr;
+  }
+
+  Option<uint32_t> ip;
+
+  acquire();
+
+  boost::unordered_map<string, Entry>::iterator iterator =
+    entries->find(hostname);
+
+  if (iterator != entries->end() && iterator->second.expires > now()) {
+    counters.hits++;
+    ip = iterator->second.ip;
+  }
+
+  release();
+
+  return ip;
+}
+
+
+// Looks up hostnames on behalf of 'lookup' so that the callers
+// don't block (the lookups block this process instead).
+class ResolverProcess : public Process<ResolverProcess>
+{
+public:
+  ResolverProcess() : ProcessBase("__dns__") {}
+
+  Future<uint32_t> lookup(const string& hostname)
+  {
+    Option<uint32_t> ip = resolve(hostname);
+
+    if (ip.isNone()) {
+      Promise<uint32_t> promise;
+      promise.fail("Failed to resolve '" + hostname + "'");
+      return promise.future();
+    }
+
+    return ip.get();
+  }
+};
+
+
+static PID<ResolverProcess> resolver;
+static pthread_once_t spawned = PTHREAD_ONCE_INIT;
+
+
+static void spawn()
+{
+  resolver = process::spawn(new ResolverProcess(), true);
+}
+
+
+Future<uint32_t> lookup(const string& hostname)
+{
+  Option<uint32_t> ip = cached(hostname);
+
+  if (ip.isSome()) {
+    return ip.get();
+  }
+
+  pthread_once(&spawned, spawn);
+
+  return dispatch(resolver, &ResolverProcess::lookup, hostname);
+}
+
+
+Statistics statistics()
+{
+  acquire();
+  Statistics statistics = counters;
+  statistics.entries = entries->size();
+  release();
+  return statistics;
+}
+
+} // namespace dns {
+
+
 size_t hash_value(const UPID& pid)
 {
   size_t seed = 0;
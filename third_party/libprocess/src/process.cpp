@@ -1,6 +1,7 @@
 #include <errno.h>
 #include <ev.h>
 #include <fcntl.h>
+#include <float.h>
 #include <limits.h>
 #include <netdb.h>
 #include <pthread.h>
@@ -25,6 +26,7 @@
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include <algorithm>
 #include <deque>
@@ -43,6 +45,7 @@
 #include <process/clock.hpp>
 #include <process/deferred.hpp>
 #include <process/dispatch.hpp>
+#include <process/dns.hpp>
 #include <process/executor.hpp>
 #include <process/filter.hpp>
 #include <process/future.hpp>
@@ -56,7 +59,9 @@
 #include "foreach.hpp"
 #include "gate.hpp"
 #include "synchronized.hpp"
+#include "table.hpp"
 #include "thread.hpp"
+#include "wheel.hpp"
 
 
 using std::deque;
@@ -196,6 +201,121 @@ private:
 };
 
 
+// Runs the thunk of an expired timer in the context of the process
+// that created the timer (see 'handle_timeouts'). If the event gets
+// deleted without having been applied (e.g., the process exited
+// while the event was queued) the timer gets handed to the timeouts
+// process instead so that the thunk still gets executed.
+struct TimerEvent : DispatchEvent
+{
+  explicit TimerEvent(const timer& _t) : t(_t), applied(false) {}
+
+  virtual ~TimerEvent();
+
+  virtual void apply(ProcessBase* process) const
+  {
+    applied = true;
+    t.thunk();
+  }
+
+  const timer t;
+  mutable bool applied;
+};
+
+
+// Runs the thunks of the expired timers that were not created by a
+// process (or whose process has since exited), see 'handle_timeouts'.
+class TimeoutsProcess : public Process<TimeoutsProcess>
+{
+public:
+  TimeoutsProcess() : ProcessBase("__timeouts__") {}
+
+  void execute(const list<timer>& timers);
+};
+
+
+// Exposes statistics about libprocess via HTTP (e.g., GET
+// /__statistics__/sockets.json).
+class StatisticsProcess : public Process<StatisticsProcess>
+{
+public:
+  StatisticsProcess() : ProcessBase("__statistics__")
+  {
+    route("sockets.json", &StatisticsProcess::sockets);
+    route("dns.json", &StatisticsProcess::dns);
+    route("mailboxes.json", &StatisticsProcess::mailboxes);
+  }
+
+  Future<HttpResponse> sockets(const HttpRequest& request);
+  Future<HttpResponse> dns(const HttpRequest& request);
+  Future<HttpResponse> mailboxes(const HttpRequest& request);
+};
+
+
+// Exposes the instrumentation of all processes via HTTP (i.e., GET
+// /__processes__).
+class ProcessesProcess : public Process<ProcessesProcess>
+{
+public:
+  ProcessesProcess() : ProcessBase("__processes__")
+  {
+    route("", &ProcessesProcess::processes);
+  }
+
+  Future<HttpResponse> processes(const HttpRequest& request);
+};
+
+
+// Snapshot of the mailbox and instrumentation of a process (see
+// ProcessManager::statistics).
+struct ProcessStatistics
+{
+  string id;
+  int thread;
+  size_t size;
+  double age;
+  size_t capacity;
+  uint64_t dropped;
+  uint64_t rejected;
+  uint64_t blocked;
+  ProcessBase::Statistics statistics;
+};
+
+
+// Counts the events handled by a process by type.
+struct EventCounter : EventVisitor
+{
+  explicit EventCounter(uint64_t* _events) : events(_events) {}
+
+  virtual void visit(const MessageEvent& event)
+  {
+    events[ProcessBase::Statistics::MESSAGE]++;
+  }
+
+  virtual void visit(const DispatchEvent& event)
+  {
+    events[ProcessBase::Statistics::DISPATCH]++;
+  }
+
+  virtual void visit(const HttpEvent& event)
+  {
+    events[ProcessBase::Statistics::HTTP]++;
+  }
+
+  virtual void visit(const ExitedEvent& event)
+  {
+    events[ProcessBase::Statistics::EXITED]++;
+  }
+
+  virtual void visit(const TerminateEvent& event)
+  {
+    events[ProcessBase::Statistics::TERMINATE]++;
+  }
+
+  uint64_t* events;
+};
+
+
 class HttpProxy : public Process<HttpProxy>
 {
 public:
@@ -224,14 +344,32 @@ public:
   void send(DataEncoder* encoder, int s, bool persist);
   void send(Message* message);
 
-  DataEncoder* next(int s);
+  DataEncoder* encode(Message* message, int s);
+
+  size_t next(int s, size_t max, DataEncoder** encoders);
+  bool sent(int s, size_t count);
 
   void closed(int s);
 
+  void upgrade(const Node& node);
+
   void exited(const Node& node);
   void exited(ProcessBase* process);
 
+  // Closes the temporary socket if it is still idle (see 'idles').
+  void expire(int s, long generation);
+
+  // Returns the number of idle temporary sockets.
+  size_t idle();
+
 private:
+  // Closes a socket once everything queued on it has been sent.
+  void dispose(int s);
+
+  // Keeps a temporary socket around for later sends to the same node
+  // (returns false if the pool is full).
+  bool pool(int s);
+
   // Map from UPID (local/remote) to process.
   map<UPID, set<ProcessBase*> > links;
 
@@ -245,12 +383,87 @@ private:
   // Set of sockets that should be closed.
   set<int> disposables;
 
-  // Map from socket to outgoing queue.
-  map<int, queue<DataEncoder*> > outgoing;
+  // Temporary sockets that have nothing left to send and are kept
+  // open for reuse (see LIBPROCESS_POOL_SIZE), mapped to the
+  // generation of the timer that closes them if they stay idle.
+  map<int, long> idles;
+  long generation;
+
+  // Map from socket to outgoing queue. The encoders at the front of
+  // the queue are the ones currently being sent (see 'send_data').
+  map<int, deque<DataEncoder*> > outgoing;
 
   // HTTP proxies.
   map<int, HttpProxy*> proxies;
 
+  // Nodes that understand binary frames (see frame.hpp) and the
+  // sockets that have been switched over to binary frames.
+  set<Node> upgradable;
+  set<int> upgraded;
+
+  // Protects instance variables.
+  synchronizable(this);
+};
+
+
+// Queue of runnable processes for a single processing thread.
+class RunQueue
+{
+public:
+  RunQueue(int _index) : index(_index), idle(false), gate(new Gate())
+  {
+    synchronizer(this) = SYNCHRONIZED_INITIALIZER;
+  }
+
+  void push(ProcessBase* process)
+  {
+    synchronized (this) {
+      processes.push_back(process);
+    }
+  }
+
+  // Returns the process that has been waiting the longest (or NULL).
+  ProcessBase* pop()
+  {
+    ProcessBase* process = NULL;
+
+    synchronized (this) {
+      if (!processes.empty()) {
+        process = processes.front();
+        processes.pop_front();
+      }
+    }
+
+    return process;
+  }
+
+  bool remove(ProcessBase* process)
+  {
+    synchronized (this) {
+      deque<ProcessBase*>::iterator it =
+        find(processes.begin(), processes.end(), process);
+      if (it != processes.end()) {
+        processes.erase(it);
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  // Index of the processing thread that owns this run queue.
+  const int index;
+
+  // True while the owning thread is (about to be) waiting at the gate.
+  volatile bool idle;
+
+  // Gate the owning thread waits at when it has nothing to run.
+  Gate* const gate;
+
+private:
+  // Runnable processes.
+  deque<ProcessBase*> processes;
+
   // Protects instance variables.
   synchronizable(this);
 };
@@ -269,7 +482,7 @@ public:
   bool deliver(int c, HttpRequest* request, ProcessBase* sender = NULL);
 
   bool deliver(const UPID& to,
-               lambda::function<void(ProcessBase*)>* f,
+               DispatchEvent* event,
                ProcessBase* sender = NULL);
 
   UPID spawn(ProcessBase* process, bool manage);
@@ -282,17 +495,35 @@ public:
   void enqueue(ProcessBase* process);
   ProcessBase* dequeue();
 
+  // Returns the statistics of all processes.
+  vector<ProcessStatistics> statistics();
+
+  // Creates the processing threads (each with its own run queue),
+  // optionally restricting the threads to run on the specified cpus.
+  void start(int threads, const vector<int>& cpus, bool pinned);
+
 private:
-  // Map of all local spawned and running processes.
-  map<string, ProcessBase*> processes;
+  // Removes the specified process from whichever run queue it is on
+  // (returns false if the process was not found on any run queue).
+  bool remove(ProcessBase* process);
+
+  // Table of all local spawned and running processes. Looking up a
+  // process doesn't take any locks, but spawning, cleaning up and
+  // waiting for processes are synchronized on 'processes'.
+  ConcurrentTable<ProcessBase*> processes;
   synchronizable(processes);
 
   // Gates for waiting threads (protected by synchronizable(processes)).
   map<ProcessBase*, Gate*> gates;
 
-  // Queue of runnable processes (implemented using list).
-  list<ProcessBase*> runq;
-  synchronizable(runq);
+  // Run queues, one per processing thread. A process gets enqueued on
+  // the run queue of the thread that it last ran on (for cache
+  // locality) and idle threads steal processes from other threads.
+  vector<RunQueue*> runqs;
+
+  // Used to distribute processes that have never run (and are not
+  // being enqueued from a processing thread) across the run queues.
+  unsigned int next;
 };
 
 
@@ -323,24 +554,147 @@ static ev_async async_watcher;
 // Watcher for timeouts.
 static ev_timer timeouts_watcher;
 
+
+// An event loop and the (I/O) thread running it. Sockets get assigned
+// to the event loops by their file descriptor (see 'loop_for') so that
+// all of the watchers of a socket run on the same thread.
+class EventLoop
+{
+public:
+  explicit EventLoop(struct ev_loop* _loop) : loop(_loop)
+  {
+    synchronizer(this) = SYNCHRONIZED_INITIALIZER;
+    ev_async_init(&async, handle_async);
+    async.data = this;
+    ev_async_start(loop, &async);
+  }
+
+  // Starts the watcher on this loop (from any thread).
+  void watch(ev_io* watcher)
+  {
+    synchronized (this) {
+      watchers.push(watcher);
+    }
+
+    // Interrupt the loop.
+    ev_async_send(loop, &async);
+  }
+
+  struct ev_loop* const loop;
+
+private:
+  static void handle_async(struct ev_loop* loop, ev_async* async, int revents)
+  {
+    ((EventLoop*) async->data)->start();
+  }
+
+  // Starts all the new I/O watchers.
+  void start()
+  {
+    synchronized (this) {
+      while (!watchers.empty()) {
+        ev_io* watcher = watchers.front();
+        watchers.pop();
+        ev_io_start(loop, watcher);
+      }
+    }
+  }
+
+  queue<ev_io*> watchers;
+  ev_async async;
+  synchronizable(this);
+};
+
+
+// All of the event loops, the first one being 'loop' which also
+// accepts connections and handles timeouts (see LIBPROCESS_IO_THREADS).
+static vector<EventLoop*>* loops = new vector<EventLoop*>();
+
+
+// Returns the event loop that the watchers of socket 's' run on.
+static EventLoop* loop_for(int s)
+{
+  return (*loops)[s % loops->size()];
+}
+
 // Server watcher for accepting connections.
 static ev_io server_watcher;
 
-// Queue of I/O watchers.
-static queue<ev_io*>* watchers = new queue<ev_io*>();
-static synchronizable(watchers) = SYNCHRONIZED_INITIALIZER;
-
-// We store the timers in a map of lists indexed by the timeout of the
-// timer so that we can have two timers that have the same timeout. We
-// exploit that the map is SORTED!
-static map<double, list<timer> >* timeouts =
-  new map<double, list<timer> >();
+// We store the timers in a timer wheel so that creating and canceling
+// a timer is cheap no matter how many timers there are.
+static TimerWheel* timeouts = new TimerWheel();
 static synchronizable(timeouts) = SYNCHRONIZED_INITIALIZER_RECURSIVE;
 
+// Earliest timeout that the timeouts watcher has been set up for (or
+// DBL_MAX if none), so that creating a timer only interrupts the loop
+// when the watcher needs to fire earlier.
+static double next_timeout = DBL_MAX;
+
+// Process that runs the thunks of expired timers that have no
+// (valid) process to run them.
+static PID<TimeoutsProcess> timeouts_process;
+
+// Process for exposing statistics.
+static PID<StatisticsProcess> statistics_process;
+
+// Process for exposing the instrumentation of processes.
+static PID<ProcessesProcess> processes_process;
+
 // Flag to indicate whether or to update the timer on async interrupt.
 static bool update_timer = false;
 
-const int NUMBER_OF_PROCESSING_THREADS = 4; // TODO(benh): Do 2x cores.
+// Whether or not to disable Nagle's algorithm (TCP_NODELAY) and to
+// cork sockets (TCP_CORK) while sending bursts of messages on the
+// sockets used for sending messages (see LIBPROCESS_TCP_NODELAY and
+// LIBPROCESS_TCP_CORK).
+static bool tcp_nodelay = true;
+static bool tcp_cork = false;
+
+// Maximum number of encoders written with a single syscall.
+const size_t MAX_ENCODERS_PER_SEND = 64;
+
+// Statistics about sending on sockets (see 'send_data').
+namespace sending {
+
+uint64_t syscalls = 0;
+uint64_t encoders = 0;
+uint64_t bytes = 0;
+
+} // namespace sending {
+
+// Maximum number of idle temporary sockets kept open for reuse and
+// for how long (see LIBPROCESS_POOL_SIZE and
+// LIBPROCESS_POOL_IDLE_TIMEOUT). Temporary sockets are created for
+// sending to nodes that haven't been linked to.
+static size_t pool_size = 64;
+static double pool_idle_timeout = 30.0;
+
+// Statistics about creating (and reusing) sockets for sending.
+namespace connecting {
+
+double started = 0;
+uint64_t connects = 0;
+uint64_t reuses = 0;
+uint64_t expirations = 0;
+
+} // namespace connecting {
+
+// Size of the buffer that sockets get received into.
+const size_t RECEIVE_BUFFER_SIZE = 80 * 1024;
+
+// Decoders of the sockets being received on, so that statistics about
+// each connection can be reported, and the totals of the decoders
+// that have been deleted (see 'forget').
+static map<int, DataDecoder*>* decoders = new map<int, DataDecoder*>();
+static DataDecoder::Statistics* decoded = new DataDecoder::Statistics();
+static synchronizable(decoders) = SYNCHRONIZED_INITIALIZER;
+
+// Minimum number of processing threads to use if neither
+// 'initialize' nor the environment (LIBPROCESS_THREADS) specify how
+// many to use. Processes are allowed to block the thread they run on
+// (e.g., awaiting a future that another process sets), so using one
+// thread per core on a machine with few cores can deadlock.
+const int DEFAULT_NUMBER_OF_PROCESSING_THREADS = 4;
 
 
 // Thread local process pointer magic (constructed in
@@ -351,28 +705,30 @@ static ThreadLocal<ProcessBase>* _process_ = NULL;
 
 #define __process__ (*_process_)
 
+// Thread local run queue pointer (constructed in 'initialize'), NULL
+// for threads that are not processing threads.
+static ThreadLocal<RunQueue>* _runq_ = NULL;
 
-// Scheduler gate.
-static Gate* gate = new Gate();
+#define __runq__ (*_runq_)
+
+// Thread local event loop pointer (constructed in 'initialize'), NULL
+// for threads that are not event loop (I/O) threads.
+static ThreadLocal<EventLoop>* _loop_ = NULL;
+
+#define __loop__ (*_loop_)
 
 // Filter. Synchronized support for using the filterer needs to be
 // recursive incase a filterer wants to do anything fancy (which is
 // possible and likely given that filters will get used for testing).
-static Filter* filterer = NULL;
+// Since filters are only used for testing the pointer is volatile so
+// that enqueuing can cheaply check whether or not a filter is
+// installed before acquiring the lock (see ProcessBase::enqueue).
+static Filter* volatile filterer = NULL;
 static synchronizable(filterer) = SYNCHRONIZED_INITIALIZER_RECURSIVE;
 
 // Global garbage collector.
 PID<GarbageCollector> gc;
 
-// Thunks to be invoked via process::invoke.
-static queue<lambda::function<void(void)>*>* thunks =
-  new queue<lambda::function<void(void)>*>();
-static synchronizable(thunks) = SYNCHRONIZED_INITIALIZER;
-
-// Thread to invoke thunks (see above).
-static Gate* invoke_gate = new Gate();
-static pthread_t invoke_thread;
-
 
 // We namespace the clock related variables to keep them well
 // named. In the future we'll probably want to associate a clock with
@@ -535,7 +891,7 @@ int set_nbio(int fd)
 }
 
 
-Message* encode(const UPID &from, const UPID &to, const string &name, const string &data = "")
+Message* encode(const UPID &from, const UPID &to, const string &name, const Buffer &data = Buffer())
 {
   Message* message = new Message();
   message->from = from;
@@ -584,7 +940,7 @@ Message* parse(HttpRequest* request)
       message->name = name;
       message->from = from;
       message->to = to;
-      message->body = request->body;
+      message->body = Buffer::take(&request->body);
 
       return message;
     }
@@ -596,20 +952,12 @@ Message* parse(HttpRequest* request)
 
 void handle_async(struct ev_loop* loop, ev_async* _, int revents)
 {
-  synchronized (watchers) {
-    // Start all the new I/O watchers.
-    while (!watchers->empty()) {
-      ev_io* watcher = watchers->front();
-      watchers->pop();
-      ev_io_start(loop, watcher);
-    }
-  }
-
   synchronized (timeouts) {
     if (update_timer) {
+      next_timeout = timeouts->next();
       if (!timeouts->empty()) {
 	// Determine when the next timer should fire.
-	timeouts_watcher.repeat = timeouts->begin()->first - Clock::now();
+	timeouts_watcher.repeat = next_timeout - Clock::now();
 
         if (timeouts_watcher.repeat <= 0) {
 	  // Feed the event now!
@@ -644,29 +992,20 @@ void handle_timeouts(struct ev_loop* loop, ev_timer* _, int revents)
     VLOG(1) << "Handling timeouts up to "
             << std::fixed << std::setprecision(9) << now;
 
-    foreachkey (double timeout, *timeouts) {
-      if (timeout > now) {
-        break;
-      }
+    // Remove the timers that timed out.
+    timeouts->expire(now, &timedout);
 
-      VLOG(2) << "Have timeout(s) at "
-              << std::fixed << std::setprecision(9) << timeout;
+    VLOG(2) << "Have " << timedout.size() << " timeout(s)";
 
-      foreach (const timer& timer, (*timeouts)[timeout]) {
-        timedout.push_back(timer);
-      }
-    }
-
-    // Now erase the range of timeouts that timed out.
-    timeouts->erase(timeouts->begin(), timeouts->upper_bound(now));
+    next_timeout = timeouts->next();
 
     // Okay, so the timeout for the next timer should not have fired.
-    CHECK(timeouts->empty() || (timeouts->begin()->first > now));
+    CHECK(next_timeout > now);
 
     // Update the timer as necessary.
     if (!timeouts->empty()) {
       // Determine when the next timer should fire.
-      timeouts_watcher.repeat = timeouts->begin()->first - Clock::now();
+      timeouts_watcher.repeat = next_timeout - Clock::now();
 
       if (timeouts_watcher.repeat <= 0) {
         // Feed the event now!
@@ -692,12 +1031,13 @@ void handle_timeouts(struct ev_loop* loop, ev_timer* _, int revents)
   // be necessary to actually add some more synchronization around
   // this so that, for example, pausing and resuming the clock doesn't
   // cause some processes to get thier current times updated and
-  // others not. Since ProcessManager::use acquires the 'processes'
-  // lock we had to move this out of the synchronized (timeouts) above
-  // since there was a deadlock with acquring 'processes' then
-  // 'timeouts' (reverse order) in ProcessManager::cleanup. Note that
-  // current time may be greater than the timeout if a local message
-  // was received (and happens-before kicks in).
+  // others not. Since ProcessManager::use used to acquire the
+  // 'processes' lock we had to move this out of the synchronized
+  // (timeouts) above since there was a deadlock with acquring
+  // 'processes' then 'timeouts' (reverse order) in
+  // ProcessManager::cleanup. Note that current time may be greater
+  // than the timeout if a local message was received (and
+  // happens-before kicks in).
   if (Clock::paused()) {
     foreach (const timer& timer, timedout) {
       if (ProcessReference process = process_manager->use(timer.pid)) {
@@ -706,27 +1046,308 @@ void handle_timeouts(struct ev_loop* loop, ev_timer* _, int revents)
     }
   }
 
-  // Execute the thunks of the timeouts that timed out (TODO(benh): Do
-  // this async so that we don't tie up the event thread!).
+  // Execute the thunks of the timeouts that timed out asynchronously
+  // so that we don't tie up the event thread. The thunk of a timer
+  // created by a process becomes an event of that process, so that
+  // the thunks get executed by the processing threads (in parallel
+  // for different processes, in order with everything else for the
+  // same process). The rest get executed by the timeouts process, as
+  // do the thunks of the events that get dropped (e.g., because the
+  // process has exited, see TimerEvent::~TimerEvent).
+  list<timer> orphans;
+
   foreach (const timer& timer, timedout) {
+    if (timer.pid) {
+      process_manager->deliver(timer.pid, new TimerEvent(timer));
+    } else {
+      orphans.push_back(timer);
+    }
+  }
+
+  if (!orphans.empty()) {
+    dispatch(timeouts_process, &TimeoutsProcess::execute, orphans);
+  }
+}
+
+
+TimerEvent::~TimerEvent()
+{
+  if (!applied) {
+    dispatch(timeouts_process, &TimeoutsProcess::execute, list<timer>(1, t));
+  }
+}
+
+
+void TimeoutsProcess::execute(const list<timer>& timers)
+{
+  foreach (const timer& timer, timers) {
+    // Using a manual clock, so make sure anything the thunk does
+    // happens after the timeout (e.g., a delayed dispatch).
+    if (Clock::paused()) {
+      Clock::update(this, timer.timeout);
+    }
+
     timer.thunk();
   }
 }
 
 
+Future<HttpResponse> StatisticsProcess::sockets(const HttpRequest& request)
+{
+  // Note that the counters keep getting updated by the event loops
+  // while we read them, so these might be slightly inconsistent.
+  const uint64_t syscalls = sending::syscalls;
+  const uint64_t encoders = sending::encoders;
+  const uint64_t bytes = sending::bytes;
+
+  const uint64_t connects = connecting::connects;
+  const double elapsed = Clock::now() - connecting::started;
+
+  std::ostringstream out;
+
+  out << "{";
+
+  // Statistics about receiving, overall and for each connection.
+  synchronized (decoders) {
+    DataDecoder::Statistics total = *decoded;
+
+    out << "\"connections\":[";
+
+    bool first = true;
+
+    foreachpair (int s, DataDecoder* decoder, *decoders) {
+      const DataDecoder::Statistics& statistics = decoder->statistics();
+      total += statistics;
+      out << (first ? "" : ",");
+      first = false;
+      out << "{"
+          << "\"socket\":" << s << ","
+          << "\"reads\":" << statistics.reads << ","
+          << "\"received_bytes\":" << statistics.bytes << ","
+          << "\"requests\":" << statistics.requests << ","
+          << "\"messages\":" << statistics.messages << ","
+          << "\"buffered_bytes\":" << statistics.buffered
+          << "}";
+    }
+
+    out << "],"
+        << "\"reads\":" << total.reads << ","
+        << "\"received_bytes\":" << total.bytes << ","
+        << "\"received_requests\":" << total.requests << ","
+        << "\"received_messages\":" << total.messages << ","
+        << "\"buffered_bytes\":" << total.buffered << ","
+        << "\"bytes_per_read\":"
+        << (total.reads > 0 ? (double) total.bytes / total.reads : 0) << ",";
+  }
+
+  out << "\"send_syscalls\":" << syscalls << ","
+      << "\"sent_messages\":" << encoders << ","
+      << "\"sent_bytes\":" << bytes << ","
+      << "\"messages_per_syscall\":"
+      << (syscalls > 0 ? (double) encoders / syscalls : 0) << ","
+      << "\"bytes_per_syscall\":"
+      << (syscalls > 0 ? (double) bytes / syscalls : 0) << ","
+      << "\"tcp_nodelay\":" << (tcp_nodelay ? "true" : "false") << ","
+      << "\"tcp_cork\":" << (tcp_cork ? "true" : "false") << ","
+      << "\"connects\":" << connects << ","
+      << "\"connects_per_second\":"
+      << (elapsed > 0 ? connects / elapsed : 0) << ","
+      << "\"reused_connections\":" << connecting::reuses << ","
+      << "\"expired_connections\":" << connecting::expirations << ","
+      << "\"idle_connections\":" << socket_manager->idle() << ","
+      << "\"pool_size\":" << pool_size
+      << "}";
+
+  HttpOKResponse response;
+  response.headers["Content-Type"] = "application/json";
+  response.body = out.str();
+  return response;
+}
+
+
+Future<HttpResponse> StatisticsProcess::mailboxes(const HttpRequest& request)
+{
+  std::ostringstream out;
+
+  out << "[";
+
+  bool first = true;
+
+  foreach (const ProcessStatistics& mailbox, process_manager->statistics()) {
+    out << (first ? "" : ",");
+    first = false;
+    out << "{"
+        << "\"id\":\"" << mailbox.id << "\","
+        << "\"queued\":" << mailbox.size << ","
+        << "\"queued_secs\":" << mailbox.age << ","
+        << "\"capacity\":" << mailbox.capacity << ","
+        << "\"dropped\":" << mailbox.dropped << ","
+        << "\"rejected\":" << mailbox.rejected << ","
+        << "\"blocked\":" << mailbox.blocked
+        << "}";
+  }
+
+  out << "]";
+
+  HttpOKResponse response;
+  response.headers["Content-Type"] = "application/json";
+  response.body = out.str();
+  return response;
+}
+
+
+Future<HttpResponse> ProcessesProcess::processes(const HttpRequest& request)
+{
+  static const char* types[] = { "message", "dispatch", "http", "exited",
+                                 "terminate" };
+
+  std::ostringstream out;
+
+  out << "[";
+
+  bool first = true;
+
+  foreach (const ProcessStatistics& process, process_manager->statistics()) {
+    const ProcessBase::Statistics& statistics = process.statistics;
+
+    out << (first ? "" : ",");
+    first = false;
+
+    out << "{"
+        << "\"id\":\"" << process.id << "\","
+        << "\"thread\":" << process.thread << ","
+        << "\"events\":{";
+
+    uint64_t events = 0;
+
+    for (int i = 0; i < ProcessBase::Statistics::TYPES; i++) {
+      out << (i > 0 ? "," : "")
+          << "\"" << types[i] << "\":" << statistics.events[i];
+      events += statistics.events[i];
+    }
+
+    // The histogram is keyed by the (exclusive) upper bound of each
+    // bucket in microseconds, leaving out empty buckets.
+    out << "},"
+        << "\"handled_secs\":" << statistics.handled << ","
+        << "\"mean_handled_secs\":"
+        << (events > 0 ? statistics.handled / events : 0) << ","
+        << "\"max_handled_secs\":" << statistics.slowest << ","
+        << "\"handled_usecs_histogram\":{";
+
+    bool empty = true;
+
+    for (int i = 0; i < ProcessBase::Statistics::BUCKETS; i++) {
+      if (statistics.handling[i] > 0) {
+        out << (empty ? "" : ",") << "\"";
+        if (i < ProcessBase::Statistics::BUCKETS - 1) {
+          out << (1ULL << i);
+        } else {
+          out << "inf";
+        }
+        out << "\":" << statistics.handling[i];
+        empty = false;
+      }
+    }
+
+    out << "},"
+        << "\"queued_secs\":" << statistics.queued << ","
+        << "\"mean_queued_secs\":"
+        << (events > 0 ? statistics.queued / events : 0) << ","
+        << "\"max_queued_secs\":" << statistics.longest << ","
+        << "\"queued\":" << process.size << ","
+        << "\"max_queued\":" << statistics.high << ","
+        << "\"capacity\":" << process.capacity << ","
+        << "\"dropped\":" << process.dropped << ","
+        << "\"rejected\":" << process.rejected << ","
+        << "\"blocked\":" << process.blocked
+        << "}";
+  }
+
+  out << "]";
+
+  HttpOKResponse response;
+  response.headers["Content-Type"] = "application/json";
+  response.body = out.str();
+  return response;
+}
+
+
+Future<HttpResponse> StatisticsProcess::dns(const HttpRequest& request)
+{
+  const process::dns::Statistics& statistics = process::dns::statistics();
+
+  std::ostringstream out;
+
+  out << "{"
+      << "\"hits\":" << statistics.hits << ","
+      << "\"misses\":" << statistics.misses << ","
+      << "\"failures\":" << statistics.failures << ","
+      << "\"entries\":" << statistics.entries
+      << "}";
+
+  HttpOKResponse response;
+  response.headers["Content-Type"] = "application/json";
+  response.body = out.str();
+  return response;
+}
+
+
+// Disables Nagle's algorithm on a socket used for sending messages
+// (if enabled via LIBPROCESS_TCP_NODELAY) so that small messages
+// don't get delayed waiting for acknowledgements.
+static void set_nodelay(int s)
+{
+  if (tcp_nodelay) {
+    int on = 1;
+    if (setsockopt(s, SOL_TCP, TCP_NODELAY, &on, sizeof(on)) < 0) {
+      PLOG(WARNING) << "Failed to set TCP_NODELAY";
+    }
+  }
+}
+
+
+// Keeps track of the decoder for receiving on socket 's' (see
+// 'decoders').
+static void remember(int s, DataDecoder* decoder)
+{
+  synchronized (decoders) {
+    (*decoders)[s] = decoder;
+  }
+}
+
+
+// Stops keeping track of the decoder and deletes it. Note that the
+// socket might already have been reused (and have a new decoder).
+static void forget(int s, DataDecoder* decoder)
+{
+  synchronized (decoders) {
+    if (decoders->count(s) > 0 && (*decoders)[s] == decoder) {
+      decoders->erase(s);
+    }
+    *decoded += decoder->statistics();
+  }
+
+  delete decoder;
+}
+
+
 void recv_data(struct ev_loop *loop, ev_io *watcher, int revents)
 {
   DataDecoder* decoder = (DataDecoder*) watcher->data;
   
   int c = watcher->fd;
 
-  while (true) {
-    const ssize_t size = 80 * 1024;
-    ssize_t length = 0;
+  // All sockets of an event loop get received into the same buffer
+  // since decoders copy out whatever they need to keep.
+  static __thread char* data = NULL;
 
-    char data[size];
+  if (data == NULL) {
+    data = new char[RECEIVE_BUFFER_SIZE];
+  }
 
-    length = recv(c, data, size, 0);
+  while (true) {
+    ssize_t length = recv(c, data, RECEIVE_BUFFER_SIZE, 0);
 
     if (length < 0 && (errno == EINTR)) {
       // Interrupted, try again now.
@@ -743,24 +1364,38 @@ void recv_data(struct ev_loop *loop, ev_io *watcher, int revents)
         VLOG(2) << "Socket closed while receiving";
       }
       socket_manager->closed(c);
-      delete decoder;
+      forget(c, decoder);
       ev_io_stop(loop, watcher);
       delete watcher;
       break;
     } else {
       CHECK(length > 0);
 
-      // Decode as much of the data as possible into HTTP requests.
+      // Decode as much of the data as possible into HTTP requests
+      // (or messages if the connection uses binary frames).
       const deque<HttpRequest*>& requests = decoder->decode(data, length);
+      const deque<Message*>& messages = decoder->messages();
+
+      if (!messages.empty()) {
+        // The sender evidently understands binary frames.
+        const UPID& from = messages.front()->from;
+        socket_manager->upgrade(Node(from.ip, from.port));
+      }
+
+      foreach (Message* message, messages) {
+        message->to.ip = ip;
+        message->to.port = port;
+        process_manager->deliver(message);
+      }
 
       if (!requests.empty()) {
         foreach (HttpRequest* request, requests) {
           process_manager->deliver(c, request);
         }
-      } else if (requests.empty() && decoder->failed()) {
+      } else if (messages.empty() && decoder->failed()) {
         VLOG(2) << "Decoder error while receiving";
         socket_manager->closed(c);
-        delete decoder;
+        forget(c, decoder);
         ev_io_stop(loop, watcher);
         delete watcher;
         break;
@@ -772,26 +1407,80 @@ void recv_data(struct ev_loop *loop, ev_io *watcher, int revents)
 
 void send_data(struct ev_loop *loop, ev_io *watcher, int revents)
 {
-  DataEncoder* encoder = (DataEncoder*) watcher->data;
-
   int c = watcher->fd;
 
+  // Whether or not we've corked the socket (if TCP_CORK is enabled)
+  // because there was more queued than we could send at once.
+  bool corked = false;
+
   while (true) {
-    const void* data;
-    size_t size;
+    // Gather as much of what is queued for this socket as we can so
+    // that it can all be sent with one syscall.
+    DataEncoder* encoders[MAX_ENCODERS_PER_SEND];
+    size_t sizes[MAX_ENCODERS_PER_SEND]; // Bytes gathered per encoder.
+    struct iovec iov[MAX_ENCODERS_PER_SEND * DataEncoder::MAX_PARTS];
 
-    data = encoder->next(&size);
-    CHECK(size > 0);
+    size_t count = socket_manager->next(c, MAX_ENCODERS_PER_SEND, encoders);
 
-    ssize_t length = send(c, data, size, MSG_NOSIGNAL);
+    if (count == 0) {
+      // Socket was closed and its queue discarded.
+      ev_io_stop(loop, watcher);
+      delete watcher;
+      break;
+    }
+
+    // Each part of an encoder (e.g., the body of a message) gets its
+    // own entry so that nothing needs to be copied.
+    size_t parts = 0;
+
+    for (size_t i = 0; i < count; i++) {
+      sizes[i] = 0;
+      while (encoders[i]->remaining() > 0) {
+        CHECK(parts < MAX_ENCODERS_PER_SEND * DataEncoder::MAX_PARTS);
+        iov[parts].iov_base = (void*) encoders[i]->next(&iov[parts].iov_len);
+        sizes[i] += iov[parts].iov_len;
+        parts++;
+      }
+      CHECK(sizes[i] > 0);
+    }
+
+#ifdef TCP_CORK
+    if (tcp_cork && !corked && count == MAX_ENCODERS_PER_SEND) {
+      int on = 1;
+      setsockopt(c, SOL_TCP, TCP_CORK, &on, sizeof(on));
+      corked = true;
+    }
+#endif // TCP_CORK
+
+    // Use 'sendmsg' rather than 'writev' so that we can pass
+    // MSG_NOSIGNAL.
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = iov;
+    message.msg_iovlen = parts;
+
+    ssize_t length = sendmsg(c, &message, MSG_NOSIGNAL);
+
+    // Update the encoders with the amount sent, counting how many of
+    // them were sent completely.
+    size_t completed = 0;
+    size_t remaining = length > 0 ? length : 0;
+
+    for (size_t i = 0; i < count; i++) {
+      if (remaining >= sizes[i]) {
+        remaining -= sizes[i];
+        completed++;
+      } else {
+        encoders[i]->backup(sizes[i] - remaining);
+        remaining = 0;
+      }
+    }
 
     if (length < 0 && (errno == EINTR)) {
       // Interrupted, try again now.
-      encoder->backup(size);
       continue;
     } else if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
       // Might block, try again later.
-      encoder->backup(size);
       break;
     } else if (length <= 0) {
       // Socket error or closed.
@@ -802,33 +1491,44 @@ void send_data(struct ev_loop *loop, ev_io *watcher, int revents)
         VLOG(2) << "Socket closed while sending";
       }
       socket_manager->closed(c);
-      delete encoder;
       ev_io_stop(loop, watcher);
       delete watcher;
+      corked = false;
       break;
     } else {
       CHECK(length > 0);
 
-      // Update the encoder with the amount sent.
-      encoder->backup(size - length);
-
-      // See if there is any more of the message to send.
-      if (encoder->remaining() == 0) {
-        delete encoder;
+      __sync_fetch_and_add(&sending::syscalls, 1);
+      __sync_fetch_and_add(&sending::encoders, completed);
+      __sync_fetch_and_add(&sending::bytes, length);
+
+#ifdef TCP_CORK
+      // Nothing more was queued when we gathered this batch, so
+      // uncork to push out whatever might be left in the kernel.
+      if (corked && count < MAX_ENCODERS_PER_SEND) {
+        int off = 0;
+        setsockopt(c, SOL_TCP, TCP_CORK, &off, sizeof(off));
+        corked = false;
+      }
+#endif // TCP_CORK
 
-        // Check for more stuff to send on socket.
-        encoder = socket_manager->next(c);
-        if (encoder != NULL) {
-          watcher->data = encoder;
-        } else {
-          // Nothing more to send right now, clean up.
-          ev_io_stop(loop, watcher);
-          delete watcher;
-          break;
-        }
+      // Remove what was sent, and see if there is anything else to
+      // send on the socket (if not, the socket might get closed).
+      if (!socket_manager->sent(c, completed)) {
+        // Nothing more to send right now, clean up.
+        ev_io_stop(loop, watcher);
+        delete watcher;
+        break;
       }
     }
   }
+
+#ifdef TCP_CORK
+  if (corked) {
+    int off = 0;
+    setsockopt(c, SOL_TCP, TCP_CORK, &off, sizeof(off));
+  }
+#endif // TCP_CORK
 }
 
 
@@ -844,8 +1544,6 @@ void sending_connect(struct ev_loop *loop, ev_io *watcher, int revents)
     // Connect failure.
     VLOG(1) << "Socket error while connecting";
     socket_manager->closed(c);
-    MessageEncoder* encoder = (MessageEncoder*) watcher->data;
-    delete encoder;
     ev_io_stop(loop, watcher);
     delete watcher;
   } else {
@@ -870,7 +1568,7 @@ void receiving_connect(struct ev_loop *loop, ev_io *watcher, int revents)
     VLOG(1) << "Socket error while connecting";
     socket_manager->closed(c);
     DataDecoder* decoder = (DataDecoder*) watcher->data;
-    delete decoder;
+    forget(c, decoder);
     ev_io_stop(loop, watcher);
     delete watcher;
   } else {
@@ -907,19 +1605,107 @@ void accept(struct ev_loop *loop, ev_io *watcher, int revents)
   } else {
     // Allocate and initialize the decoder and watcher.
     DataDecoder* decoder = new DataDecoder();
+    remember(c, decoder);
 
     ev_io *watcher = new ev_io();
     watcher->data = decoder;
 
     ev_io_init(watcher, recv_data, c, EV_READ);
-    ev_io_start(loop, watcher);
+
+    // Receive on the event loop of the socket, which might not be
+    // the one accepting connections.
+    EventLoop* target = loop_for(c);
+    if (target->loop == loop) {
+      ev_io_start(loop, watcher);
+    } else {
+      target->watch(watcher);
+    }
+  }
+}
+
+
+// Parses a list of cpus such as "0-3,8,10-11". An entry of the form
+// "nodeN" is expanded to all of the cpus on NUMA node N (as reported
+// by sysfs). Returns false if the list could not be parsed.
+bool parse_cpus(const string& s, vector<int>* cpus)
+{
+  std::istringstream in(s);
+  string entry;
+
+  while (std::getline(in, entry, ',')) {
+    if (entry.empty()) {
+      continue;
+    }
+
+    if (entry.find("node") == 0) {
+      std::ifstream file(
+          ("/sys/devices/system/node/" + entry + "/cpulist").c_str());
+
+      string cpulist;
+      if (!std::getline(file, cpulist) || cpulist.find("node") != string::npos ||
+          !parse_cpus(cpulist, cpus)) {
+        return false;
+      }
+
+      continue;
+    }
+
+    int first = -1;
+    int last = -1;
+    char dash;
+
+    std::istringstream range(entry);
+    range >> first;
+    if (range.fail() || first < 0) {
+      return false;
+    } else if (range >> dash) {
+      if (dash != '-' || !(range >> last) || last < first) {
+        return false;
+      }
+    } else {
+      last = first;
+    }
+
+    for (int cpu = first; cpu <= last; cpu++) {
+      cpus->push_back(cpu);
+    }
+  }
+
+  return !cpus->empty();
+}
+
+
+// Restricts the specified thread to run on only the specified cpus.
+void pin(pthread_t thread, const vector<int>& cpus)
+{
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+
+  foreach (int cpu, cpus) {
+    if (cpu < CPU_SETSIZE) {
+      CPU_SET(cpu, &set);
+    }
+  }
+
+  int result = pthread_setaffinity_np(thread, sizeof(set), &set);
+  if (result != 0) {
+    LOG(WARNING) << "Failed to set cpu affinity of thread: "
+                 << strerror(result);
   }
+#else
+  LOG(WARNING) << "Setting the cpu affinity of threads is not supported";
+#endif // __linux__
 }
 
 
 void* serve(void* arg)
 {
-  ev_loop(((struct ev_loop*) arg), 0);
+  EventLoop* loop = (EventLoop*) arg;
+
+  __loop__ = loop;
+
+  ev_loop(loop->loop, 0);
 
   return NULL;
 }
@@ -929,16 +1715,26 @@ void* schedule(void* arg)
 {
   __process__ = NULL; // Start off not running anything.
 
+  RunQueue* runq = (RunQueue*) arg;
+
+  __runq__ = runq;
+
   do {
     ProcessBase* process = process_manager->dequeue();
     if (process == NULL) {
-      Gate::state_t old = gate->approach();
+      Gate::state_t old = runq->gate->approach();
+      // Mark ourselves as idle _before_ checking the run queues again
+      // so that an enqueue either gets seen below or opens our gate.
+      runq->idle = true;
+      __sync_synchronize();
       process = process_manager->dequeue();
       if (process == NULL) {
-	gate->arrive(old); // Wait at gate if idle.
+	runq->gate->arrive(old); // Wait at gate if idle.
+        runq->idle = false;
 	continue;
       } else {
-	gate->leave();
+        runq->idle = false;
+	runq->gate->leave();
       }
     }
     process_manager->resume(process);
@@ -963,7 +1759,7 @@ void* schedule(void* arg)
 // }
 
 
-void initialize(bool initialize_google_logging)
+void initialize(bool initialize_google_logging, int threads)
 {
 //   static pthread_once_t init = PTHREAD_ONCE_INIT;
 //   pthread_once(&init, ...);
@@ -1028,19 +1824,120 @@ void initialize(bool initialize_google_logging)
 
   _process_ = new ThreadLocal<ProcessBase>(key);
 
-  // Setup processing threads.
-  for (int i = 0; i < NUMBER_OF_PROCESSING_THREADS; i++) {
-    pthread_t thread; // For now, not saving handles on our threads.
-    if (pthread_create(&thread, NULL, schedule, NULL) != 0) {
-      LOG(FATAL) << "Failed to initialize, pthread_create";
+  // Setup the thread local run queue pointer.
+  if (pthread_key_create(&key, NULL) != 0) {
+    LOG(FATAL) << "Failed to initialize, pthread_key_create";
+  }
+
+  _runq_ = new ThreadLocal<RunQueue>(key);
+
+  // Setup the thread local event loop pointer.
+  if (pthread_key_create(&key, NULL) != 0) {
+    LOG(FATAL) << "Failed to initialize, pthread_key_create";
+  }
+
+  _loop_ = new ThreadLocal<EventLoop>(key);
+
+  char *value;
+
+  // Determine the number of processing threads, preferring the value
+  // passed to 'initialize', then the environment, then the number of
+  // cores on the machine.
+  value = getenv("LIBPROCESS_THREADS");
+  if (threads <= 0 && value != NULL) {
+    threads = atoi(value);
+    if (threads <= 0) {
+      LOG(FATAL) << "LIBPROCESS_THREADS=" << value
+                 << " is not a valid number of threads";
+    }
+  }
+
+  if (threads <= 0) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = max(cores, (long) DEFAULT_NUMBER_OF_PROCESSING_THREADS);
+  }
+
+  // Determine the number of event loop (I/O) threads.
+  int io_threads = 1;
+
+  value = getenv("LIBPROCESS_IO_THREADS");
+  if (value != NULL) {
+    io_threads = atoi(value);
+    if (io_threads <= 0) {
+      LOG(FATAL) << "LIBPROCESS_IO_THREADS=" << value
+                 << " is not a valid number of threads";
+    }
+  }
+
+  // Check environment for whether or not to set TCP_NODELAY and use
+  // TCP_CORK on the sockets used for sending messages.
+  value = getenv("LIBPROCESS_TCP_NODELAY");
+  if (value != NULL) {
+    tcp_nodelay = atoi(value) != 0;
+  }
+
+  value = getenv("LIBPROCESS_TCP_CORK");
+  if (value != NULL) {
+    tcp_cork = atoi(value) != 0;
+  }
+
+  // Check environment for how many idle temporary sockets to keep
+  // open for reuse and for how long.
+  value = getenv("LIBPROCESS_POOL_SIZE");
+  if (value != NULL) {
+    int size = atoi(value);
+    if (size < 0) {
+      LOG(FATAL) << "LIBPROCESS_POOL_SIZE=" << value
+                 << " is not a valid number of sockets";
+    }
+    pool_size = size;
+  }
+
+  value = getenv("LIBPROCESS_POOL_IDLE_TIMEOUT");
+  if (value != NULL) {
+    pool_idle_timeout = atof(value);
+    if (pool_idle_timeout <= 0) {
+      LOG(FATAL) << "LIBPROCESS_POOL_IDLE_TIMEOUT=" << value
+                 << " is not a valid number of seconds";
     }
   }
 
+  // Check environment for the cpus to run the event loop (I/O) thread
+  // and the processing threads on.
+  vector<int> io_cpus;
+
+  value = getenv("LIBPROCESS_IO_CPUS");
+  if (value != NULL && !parse_cpus(value, &io_cpus)) {
+    LOG(FATAL) << "LIBPROCESS_IO_CPUS=" << value << " was unparseable";
+  }
+
+  vector<int> cpus;
+  bool pinned = false;
+
+  value = getenv("LIBPROCESS_CPUS");
+  if (value != NULL) {
+    if (!parse_cpus(value, &cpus)) {
+      LOG(FATAL) << "LIBPROCESS_CPUS=" << value << " was unparseable";
+    }
+    pinned = true;
+  } else if (!io_cpus.empty()) {
+    // Keep the processing threads off of the cpus used for I/O.
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int cpu = 0; cpu < cores; cpu++) {
+      if (find(io_cpus.begin(), io_cpus.end(), cpu) == io_cpus.end()) {
+        cpus.push_back(cpu);
+      }
+    }
+  }
+
+  VLOG(1) << "Using " << threads << " processing threads";
+
+  // Setup processing threads.
+  process_manager->start(threads, cpus, pinned);
+
   ip = 0;
   port = 0;
 
-  char *value;
-
   // Check environment for ip.
   value = getenv("LIBPROCESS_IP");
   if (value != NULL) {
@@ -1133,6 +2030,17 @@ void initialize(bool initialize_google_logging)
   ev_async_init(&async_watcher, handle_async);
   ev_async_start(loop, &async_watcher);
 
+  loops->push_back(new EventLoop(loop));
+
+  // Setup any additional event loops for sockets.
+  for (int i = 1; i < io_threads; i++) {
+#ifdef __sun__
+    loops->push_back(new EventLoop(ev_loop_new(EVBACKEND_POLL | EVBACKEND_SELECT)));
+#else
+    loops->push_back(new EventLoop(ev_loop_new(EVFLAG_AUTO)));
+#endif // __sun__
+  }
+
   ev_timer_init(&timeouts_watcher, handle_timeouts, 0., 2100000.0);
   ev_timer_again(loop, &timeouts_watcher);
 
@@ -1154,9 +2062,17 @@ void initialize(bool initialize_google_logging)
 //   sigaddset (&sa.sa_mask, w->signum);
 //   sigprocmask (SIG_UNBLOCK, &sa.sa_mask, 0);
 
-  pthread_t thread; // For now, not saving handles on our threads.
-  if (pthread_create(&thread, NULL, serve, loop) != 0) {
-    LOG(FATAL) << "Failed to initialize, pthread_create";
+  VLOG(1) << "Using " << loops->size() << " event loop (I/O) threads";
+
+  foreach (EventLoop* loop, *loops) {
+    pthread_t thread; // For now, not saving handles on our threads.
+    if (pthread_create(&thread, NULL, serve, loop) != 0) {
+      LOG(FATAL) << "Failed to initialize, pthread_create";
+    }
+
+    if (!io_cpus.empty()) {
+      pin(thread, io_cpus);
+    }
   }
 
   // Need to set initialzing here so that we can actually invoke
@@ -1166,6 +2082,17 @@ void initialize(bool initialize_google_logging)
   // Create global garbage collector.
   gc = spawn(new GarbageCollector());
 
+  // Create the process for executing the thunks of expired timers.
+  timeouts_process = spawn(new TimeoutsProcess());
+
+  // Create the process for exposing statistics.
+  statistics_process = spawn(new StatisticsProcess());
+
+  // Create the process for exposing the instrumentation of processes.
+  processes_process = spawn(new ProcessesProcess());
+
+  connecting::started = Clock::now();
+
   char temp[INET_ADDRSTRLEN];
   if (inet_ntop(AF_INET, (in_addr *) &ip, temp, INET_ADDRSTRLEN) == NULL) {
     PLOG(FATAL) << "Failed to initialize, inet_ntop";
@@ -1275,6 +2202,7 @@ void HttpProxy::unavailable(Future<HttpResponse>* future, bool persist)
 
 
 SocketManager::SocketManager()
+  : generation(0)
 {
   synchronizer(this) = SYNCHRONIZED_INITIALIZER_RECURSIVE;
 }
@@ -1311,10 +2239,14 @@ void SocketManager::link(ProcessBase *process, const UPID &to)
         PLOG(FATAL) << "Failed to link, set_nbio";
       }
 
+      set_nodelay(s);
+
       sockets[s] = node;
 
       persists[node] = s;
 
+      __sync_fetch_and_add(&connecting::connects, 1);
+
       sockaddr_in addr;
       memset(&addr, 0, sizeof(addr));
       addr.sin_family = PF_INET;
@@ -1323,6 +2255,7 @@ void SocketManager::link(ProcessBase *process, const UPID &to)
 
       // Allocate and initialize the decoder and watcher.
       DataDecoder* decoder = new DataDecoder();
+      remember(s, decoder);
 
       ev_io *watcher = new ev_io();
       watcher->data = decoder;
@@ -1339,13 +2272,8 @@ void SocketManager::link(ProcessBase *process, const UPID &to)
         ev_io_init(watcher, recv_data, s, EV_READ);
       }
 
-      // Enqueue the watcher.
-      synchronized (watchers) {
-        watchers->push(watcher);
-      }
-
-      // Interrupt the loop.
-      ev_async_send(loop, &async_watcher);
+      // Start the watcher on the event loop of the socket.
+      loop_for(s)->watch(watcher);
     }
 
     links[to].insert(process);
@@ -1355,10 +2283,35 @@ void SocketManager::link(ProcessBase *process, const UPID &to)
 
 PID<HttpProxy> SocketManager::proxy(int s)
 {
+  PID<HttpProxy> pid;
+
   synchronized (this) {
     if (sockets.count(s) > 0) {
       CHECK(proxies.count(s) > 0);
-      return proxies[s]->self();
+      pid = proxies[s]->self();
+    }
+  }
+
+  if (pid) {
+    return pid;
+  }
+
+  // Spawn the proxy without holding the lock since spawning
+  // synchronizes on the processes while ProcessManager::cleanup
+  // invokes SocketManager::exited while synchronized on the processes
+  // (i.e., the opposite order), which can deadlock with multiple
+  // processing threads.
+  HttpProxy* proxy = new HttpProxy(s);
+  spawn(proxy, true);
+
+  synchronized (this) {
+    if (sockets.count(s) > 0) {
+      // Another thread created a proxy for this socket in the mean
+      // time, so use that one instead (the garbage collector cleans
+      // up ours).
+      CHECK(proxies.count(s) > 0);
+      terminate(proxy);
+      pid = proxies[s]->self();
     } else {
       // Register the socket with the manager for sending purposes. The
       // current design doesn't let us create a valid "node" for this
@@ -1367,12 +2320,12 @@ PID<HttpProxy> SocketManager::proxy(int s)
 
       CHECK(proxies.count(s) == 0);
 
-      HttpProxy* proxy = new HttpProxy(s);
-      spawn(proxy, true);
       proxies[s] = proxy;
-      return proxy->self();
+      pid = proxy->self();
     }
   }
+
+  return pid;
 }
 
 
@@ -1390,22 +2343,17 @@ void SocketManager::send(DataEncoder* encoder, int s, bool persist)
   synchronized (this) {
     if (sockets.count(s) > 0) {
       if (outgoing.count(s) > 0) {
-        outgoing[s].push(encoder);
+        outgoing[s].push_back(encoder);
       } else {
         // Initialize the outgoing queue.
-        outgoing[s];
+        outgoing[s].push_back(encoder);
 
         // Allocate and initialize the watcher.
         ev_io *watcher = new ev_io();
-        watcher->data = encoder;
 
         ev_io_init(watcher, send_data, s, EV_WRITE);
 
-        synchronized (watchers) {
-          watchers->push(watcher);
-        }
-
-        ev_async_send(loop, &async_watcher);
+        loop_for(s)->watch(watcher);
       }
 
       // Set the socket to get closed if not persistant.
@@ -1424,17 +2372,33 @@ void SocketManager::send(Message* message)
 {
   CHECK(message != NULL);
 
-  DataEncoder* encoder = new MessageEncoder(message);
-
   Node node(message->to.ip, message->to.port);
 
   synchronized (this) {
     // Check if there is already a socket.
     bool persistant = persists.count(node) > 0;
     bool temporary = temps.count(node) > 0;
+
+    // Make sure an idle temporary socket didn't get closed by the
+    // other end (e.g., because it was restarted) before reusing it.
+    if (!persistant && temporary && idles.count(temps[node]) > 0) {
+      int s = temps[node];
+      idles.erase(s);
+
+      char data;
+      ssize_t length = recv(s, &data, 1, MSG_PEEK | MSG_DONTWAIT);
+      if (length == 0 || (length < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        VLOG(2) << "Idle socket to " << node << " was closed";
+        dispose(s);
+        temporary = false;
+      } else {
+        __sync_fetch_and_add(&connecting::reuses, 1);
+      }
+    }
+
     if (persistant || temporary) {
       int s = persistant ? persists[node] : temps[node];
-      send(encoder, s, persistant);
+      send(encode(message, s), s, persistant || pool_size > 0);
     } else {
       // No peristant or temporary socket to the node currently
       // exists, so we create a temporary one.
@@ -1448,84 +2412,185 @@ void SocketManager::send(Message* message)
         PLOG(FATAL) << "Failed to send, set_nbio";
       }
 
-      sockets[s] = node;
+      set_nodelay(s);
+
+      sockets[s] = node;
+
+      temps[node] = s;
+
+      if (pool_size == 0) {
+        disposables.insert(s);
+      }
+
+      __sync_fetch_and_add(&connecting::connects, 1);
+
+      // Initialize the outgoing queue.
+      outgoing[s].push_back(encode(message, s));
+
+      // Try and connect to the node using this socket.
+      sockaddr_in addr;
+      memset(&addr, 0, sizeof(addr));
+      addr.sin_family = PF_INET;
+      addr.sin_port = htons(message->to.port);
+      addr.sin_addr.s_addr = message->to.ip;
+
+      // Allocate and initialize the watcher.
+      ev_io *watcher = new ev_io();
+    
+      if (connect(s, (sockaddr *) &addr, sizeof(addr)) < 0) {
+        if (errno != EINPROGRESS) {
+          PLOG(FATAL) << "Failed to send, connect";
+        }
+
+        // Initialize watcher for connecting.
+        ev_io_init(watcher, sending_connect, s, EV_WRITE);
+      } else {
+        // Initialize watcher for sending.
+        ev_io_init(watcher, send_data, s, EV_WRITE);
+      }
+
+      // Start the watcher on the event loop of the socket.
+      loop_for(s)->watch(watcher);
+    }
+  }
+}
+
+
+DataEncoder* SocketManager::encode(Message* message, int s)
+{
+  synchronized (this) {
+    if (upgraded.count(s) > 0) {
+      return new MessageEncoder(message, MessageEncoder::BINARY);
+    } else if (upgradable.count(sockets[s]) > 0) {
+      upgraded.insert(s);
+      return new MessageEncoder(message, MessageEncoder::UPGRADE);
+    }
+  }
+
+  return new MessageEncoder(message);
+}
+
+
+size_t SocketManager::next(int s, size_t max, DataEncoder** encoders)
+{
+  size_t count = 0;
+
+  synchronized (this) {
+    if (outgoing.count(s) > 0) {
+      CHECK(sockets.count(s) > 0);
+      const deque<DataEncoder*>& queue = outgoing[s];
+      while (count < max && count < queue.size()) {
+        encoders[count] = queue[count];
+        count++;
+      }
+    }
+  }
+
+  return count;
+}
+
+
+bool SocketManager::sent(int s, size_t count)
+{
+  synchronized (this) {
+    CHECK(sockets.count(s) > 0);
+    CHECK(outgoing.count(s) > 0);
+
+    deque<DataEncoder*>& queue = outgoing[s];
 
-      temps[node] = s;
-      disposables.insert(s);
+    CHECK(count <= queue.size());
 
-      // Initialize the outgoing queue.
-      outgoing[s];
+    while (count-- > 0) {
+      delete queue.front();
+      queue.pop_front();
+    }
 
-      // Try and connect to the node using this socket.
-      sockaddr_in addr;
-      memset(&addr, 0, sizeof(addr));
-      addr.sin_family = PF_INET;
-      addr.sin_port = htons(message->to.port);
-      addr.sin_addr.s_addr = message->to.ip;
+    if (!queue.empty()) {
+      return true; // More messages!
+    }
 
-      // Allocate and initialize the watcher.
-      ev_io *watcher = new ev_io();
-      watcher->data = encoder;
-    
-      if (connect(s, (sockaddr *) &addr, sizeof(addr)) < 0) {
-        if (errno != EINPROGRESS) {
-          PLOG(FATAL) << "Failed to send, connect";
-        }
+    // No more messages ... erase the outgoing queue.
+    outgoing.erase(s);
 
-        // Initialize watcher for connecting.
-        ev_io_init(watcher, sending_connect, s, EV_WRITE);
-      } else {
-        // Initialize watcher for sending.
-        ev_io_init(watcher, send_data, s, EV_WRITE);
+    // Close the socket if it was set for disposal, or if it is a
+    // temporary socket that doesn't fit in the pool.
+    if (disposables.count(s) > 0) {
+      dispose(s);
+    } else if (temps.count(sockets[s]) > 0 && temps[sockets[s]] == s) {
+      if (!pool(s)) {
+        dispose(s);
       }
+    }
+  }
 
-      // Enqueue the watcher.
-      synchronized (watchers) {
-        watchers->push(watcher);
-      }
+  return false;
+}
 
-      ev_async_send(loop, &async_watcher);
+
+void SocketManager::dispose(int s)
+{
+  synchronized (this) {
+    // Also try and remove from temps.
+    const Node& node = sockets[s];
+    if (temps.count(node) > 0 && temps[node] == s) {
+      temps.erase(node);
+    } else if (proxies.count(s) > 0) {
+      HttpProxy* proxy = proxies[s];
+      proxies.erase(s);
+      terminate(proxy);
     }
+
+    disposables.erase(s);
+    idles.erase(s);
+    upgraded.erase(s);
+    sockets.erase(s);
+    close(s);
   }
 }
 
 
-DataEncoder* SocketManager::next(int s)
+bool SocketManager::pool(int s)
 {
-  DataEncoder* encoder = NULL;
-
   synchronized (this) {
-    CHECK(sockets.count(s) > 0);
-    CHECK(outgoing.count(s) > 0);
+    if (idles.size() >= pool_size) {
+      return false;
+    }
 
-    if (!outgoing[s].empty()) {
-      // More messages!
-      encoder = outgoing[s].front();
-      outgoing[s].pop();
-    } else {
-      // No more messages ... erase the outgoing queue.
-      outgoing.erase(s);
-
-      // Close the socket if it was set for disposal.
-      if (disposables.count(s) > 0) {
-        // Also try and remove from temps.
-        const Node& node = sockets[s];
-        if (temps.count(node) > 0 && temps[node] == s) {
-          temps.erase(node);
-        } else if (proxies.count(s) > 0) {
-          HttpProxy* proxy = proxies[s];
-          proxies.erase(s);
-          terminate(proxy);
-        }
+    // Note that the timer doesn't get canceled when the socket gets
+    // reused, instead 'expire' ignores it unless the socket has been
+    // idle since the timer was created.
+    idles[s] = generation++;
 
-        disposables.erase(s);
-        sockets.erase(s);
-        close(s);
-      }
+    timers::create(pool_idle_timeout,
+                   lambda::bind(&SocketManager::expire, this, s, idles[s]));
+  }
+
+  return true;
+}
+
+
+void SocketManager::expire(int s, long generation)
+{
+  synchronized (this) {
+    if (idles.count(s) > 0 && idles[s] == generation) {
+      CHECK(outgoing.count(s) == 0);
+      VLOG(2) << "Closing idle socket to " << sockets[s];
+      __sync_fetch_and_add(&connecting::expirations, 1);
+      dispose(s);
     }
   }
+}
+
+
+size_t SocketManager::idle()
+{
+  size_t size = 0;
+
+  synchronized (this) {
+    size = idles.size();
+  }
 
-  return encoder;
+  return size;
 }
 
 
@@ -1548,8 +2613,24 @@ void SocketManager::closed(int s)
         proxies.erase(s);
       }
 
-      outgoing.erase(s);
+      // Don't assume that whatever is at the other end understands
+      // binary frames anymore (it might have been restarted as an
+      // older version), we'll find out again from its messages.
+      if (upgraded.count(s) > 0) {
+        upgradable.erase(node);
+        upgraded.erase(s);
+      }
+
+      // Discard anything that didn't get sent.
+      if (outgoing.count(s) > 0) {
+        foreach (DataEncoder* encoder, outgoing[s]) {
+          delete encoder;
+        }
+        outgoing.erase(s);
+      }
+
       disposables.erase(s);
+      idles.erase(s);
       sockets.erase(s);
     }
   }
@@ -1568,6 +2649,14 @@ void SocketManager::closed(int s)
 }
 
 
+void SocketManager::upgrade(const Node& node)
+{
+  synchronized (this) {
+    upgradable.insert(node);
+  }
+}
+
+
 void SocketManager::exited(const Node& node)
 {
   // TODO(benh): It would be cleaner if this routine could call back
@@ -1630,25 +2719,59 @@ void SocketManager::exited(ProcessBase* process)
 
 
 ProcessManager::ProcessManager()
+  : next(0)
 {
   synchronizer(processes) = SYNCHRONIZED_INITIALIZER;
-  synchronizer(runq) = SYNCHRONIZED_INITIALIZER;
 }
 
 
 ProcessManager::~ProcessManager() {}
 
 
+void ProcessManager::start(
+    int threads,
+    const vector<int>& cpus,
+    bool pinned)
+{
+  CHECK(threads > 0);
+  CHECK(runqs.empty());
+
+  // Create all of the run queues before starting any threads since
+  // the threads will try and steal from each other's run queues.
+  for (int i = 0; i < threads; i++) {
+    runqs.push_back(new RunQueue(i));
+  }
+
+  foreach (RunQueue* runq, runqs) {
+    pthread_t thread; // For now, not saving handles on our threads.
+    if (pthread_create(&thread, NULL, schedule, runq) != 0) {
+      LOG(FATAL) << "Failed to initialize, pthread_create";
+    }
+
+    // Pin each thread to a single cpu (wrapping around if there are
+    // more threads than cpus) when 'pinned', otherwise just restrict
+    // all of the threads to the set of cpus.
+    if (!cpus.empty()) {
+      if (pinned) {
+        pin(thread, vector<int>(1, cpus[runq->index % cpus.size()]));
+      } else {
+        pin(thread, cpus);
+      }
+    }
+  }
+}
+
+
 ProcessReference ProcessManager::use(const UPID &pid)
 {
   if (pid.ip == ip && pid.port == port) {
-    synchronized (processes) {
-      if (processes.count(pid.id) > 0) {
-        // Note that the ProcessReference constructor _must_ get
-        // called while holding the lock on processes so that waiting
-        // for references is atomic (i.e., race free).
-        return ProcessReference(processes[pid.id]);
-      }
+    ConcurrentTable<ProcessBase*>::Reader reader(processes, pid.id);
+    if (reader.get() != NULL) {
+      // Note that the ProcessReference constructor _must_ get
+      // called while we are still reading the table so that waiting
+      // for references is atomic (i.e., race free, see
+      // ProcessManager::cleanup).
+      return ProcessReference(*reader.get());
     }
   }
 
@@ -1694,6 +2817,13 @@ bool ProcessManager::deliver(int c, HttpRequest* request, ProcessBase* sender)
   Message* message = parse(request);
 
   if (message != NULL) {
+    // Remember if the sender understands binary frames so that we
+    // can use them when sending to it.
+    if (request->headers.count(frame::ADVERTISEMENT) > 0 &&
+        request->headers[frame::ADVERTISEMENT] == frame::BINARY) {
+      socket_manager->upgrade(Node(message->from.ip, message->from.port));
+    }
+
     delete request;
     return deliver(message, sender);
   }
@@ -1742,10 +2872,10 @@ bool ProcessManager::deliver(int c, HttpRequest* request, ProcessBase* sender)
 // TODO(benh): Refactor and share code with above!
 bool ProcessManager::deliver(
     const UPID& to,
-    lambda::function<void(ProcessBase*)>* f,
+    DispatchEvent* event,
     ProcessBase* sender)
 {
-  CHECK(f != NULL);
+  CHECK(event != NULL);
 
   if (ProcessReference receiver = use(to)) {
     // If we have a local sender AND we are using a manual clock
@@ -1762,9 +2892,9 @@ bool ProcessManager::deliver(
       }
     }
 
-    receiver->enqueue(new DispatchEvent(f));
+    receiver->enqueue(event);
   } else {
-    delete f;
+    delete event;
     return false;
   }
 
@@ -1777,10 +2907,8 @@ UPID ProcessManager::spawn(ProcessBase* process, bool manage)
   CHECK(process != NULL);
 
   synchronized (processes) {
-    if (processes.count(process->pid.id) > 0) {
+    if (!processes.insert(process->pid.id, process)) {
       return UPID();
-    } else {
-      processes[process->pid.id] = process;
     }
   }
 
@@ -1802,12 +2930,24 @@ void ProcessManager::resume(ProcessBase* process)
 {
   __process__ = process;
 
+  // Remember which processing thread this process is running on so
+  // that it gets enqueued on this thread's run queue next time (a
+  // thread that donated itself in 'wait' is not a processing thread).
+  if (__runq__ != NULL) {
+    process->thread = __runq__->index;
+  }
+
   VLOG(2) << "Resuming " << process->pid << " at "
           << std::fixed << std::setprecision(9) << Clock::now();
 
   bool terminate = false;
   bool blocked = false;
 
+  // With DROP_OLDEST enqueuers might be evicting messages from the
+  // mailbox (see ProcessBase::overflow).
+  const bool evicting = process->limit > 0 &&
+    process->policy == ProcessBase::DROP_OLDEST;
+
   CHECK(process->state == ProcessBase::BOTTOM ||
         process->state == ProcessBase::READY);
 
@@ -1815,30 +2955,78 @@ void ProcessManager::resume(ProcessBase* process)
     process->state = ProcessBase::RUNNING;
     try { process->initialize(); }
     catch (...) { terminate = true; }
+  } else {
+    process->state = ProcessBase::RUNNING;
   }
 
   while (!terminate && !blocked) {
-    Event* event = NULL;
-
-    process->lock();
-    {
-      if (process->events.size() > 0) {
-        event = process->events.front();
-        process->events.pop_front();
-        process->state = ProcessBase::RUNNING;
-      } else {
-        process->state = ProcessBase::BLOCKED;
-        blocked = true;
+    if (evicting) {
+      pthread_mutex_lock(&process->eviction);
+    }
+
+    Event* event = process->events.pop();
+
+    if (evicting) {
+      pthread_mutex_unlock(&process->eviction);
+    }
+
+    // Wake up a sender blocked on the full mailbox now that there is
+    // room (see ProcessBase::overflow).
+    if (event != NULL && process->limit > 0 &&
+        process->policy == ProcessBase::BLOCK) {
+      __sync_synchronize();
+      if (process->drain.waiters > 0 &&
+          process->events.size() < process->limit) {
+        pthread_mutex_lock(&process->drain.mutex);
+        pthread_cond_signal(&process->drain.cond);
+        pthread_mutex_unlock(&process->drain.mutex);
       }
     }
-    process->unlock();
 
-    if (!blocked) {
-      CHECK(event != NULL);
+    if (event == NULL) {
+      // Block, but check the mailbox once more _after_ we've changed
+      // our state since an enqueuer that saw us as RUNNING will not
+      // have put us on a run queue. If there is an event we try and
+      // become RUNNING again, which fails if an enqueuer has already
+      // made us READY (in which case we'll get resumed later).
+      process->state = ProcessBase::BLOCKED;
+      __sync_synchronize();
+
+      if (evicting) {
+        pthread_mutex_lock(&process->eviction);
+      }
+
+      const bool empty = process->events.empty();
+
+      if (evicting) {
+        pthread_mutex_unlock(&process->eviction);
+      }
 
+      if (empty ||
+          !__sync_bool_compare_and_swap(&process->state,
+                                        ProcessBase::BLOCKED,
+                                        ProcessBase::RUNNING)) {
+        blocked = true;
+      }
+    } else {
       // Determine if we should terminate.
       terminate = event->is<TerminateEvent>();
 
+      ProcessBase::Statistics* statistics = &process->statistics;
+
+      EventCounter counter(statistics->events);
+      event->visit(&counter);
+
+      const double queued = process->events.age();
+      statistics->queued += queued;
+      statistics->longest = std::max(statistics->longest, queued);
+
+      // Including the event being handled.
+      statistics->high =
+        std::max(statistics->high, process->events.size() + 1);
+
+      const double start = Mailbox::now();
+
       // Now service the event.
       try {
         process->serve(*event);
@@ -1853,6 +3041,17 @@ void ProcessManager::resume(ProcessBase* process)
         terminate = true;
       }
 
+      const double handled = Mailbox::now() - start;
+      statistics->handled += handled;
+      statistics->slowest = std::max(statistics->slowest, handled);
+
+      const uint64_t usecs = (uint64_t) (handled * 1000000);
+      int bucket = usecs == 0 ? 0 : 64 - __builtin_clzll(usecs);
+      if (bucket >= ProcessBase::Statistics::BUCKETS) {
+        bucket = ProcessBase::Statistics::BUCKETS - 1;
+      }
+      statistics->handling[bucket]++;
+
       delete event;
 
       if (terminate) {
@@ -1877,35 +3076,54 @@ void ProcessManager::cleanup(ProcessBase* process)
  
   // Remove process.
   synchronized (processes) {
-    // Wait for all process references to get cleaned up.
+    // Remove the process from the table first so that no new
+    // references can be created (erasing waits for any lookups that
+    // might still be creating a reference), then wait for all process
+    // references to get cleaned up.
+    processes.erase(process->pid.id);
+
+    // Stop accepting events. Note that an enqueuer which saw the
+    // process before it was FINISHED might still add an event, but it
+    // will get freed below or when the process is destroyed (see
+    // ProcessBase::~ProcessBase). This must happen before waiting for
+    // the references since senders blocked on a full mailbox hold a
+    // reference until they see that the process is FINISHED (see
+    // ProcessBase::overflow).
+    process->state = ProcessBase::FINISHED;
+    __sync_synchronize();
+
+    if (process->drain.waiters > 0) {
+      pthread_mutex_lock(&process->drain.mutex);
+      pthread_cond_broadcast(&process->drain.cond);
+      pthread_mutex_unlock(&process->drain.mutex);
+    }
+
     while (process->refs > 0) {
       asm ("pause");
       __sync_synchronize();
     }
 
-    process->lock();
-    {
-      // Free any pending events.
-      while (!process->events.empty()) {
-        Event* event = process->events.front();
-        process->events.pop_front();
-        delete event;
-      }
+    // Confirm process not in any run queue. Note that we must check
+    // this before the gate gets opened below since afterwards a
+    // thread waiting on the process might return and
+    // deallocate the process (and the address might get reused by a
+    // newly spawned process that _is_ on a run queue).
+    CHECK(!remove(process));
 
-      processes.erase(process->pid.id);
- 
-      // Lookup gate to wake up waiting threads.
-      map<ProcessBase*, Gate*>::iterator it = gates.find(process);
-      if (it != gates.end()) {
-        gate = it->second;
-        // N.B. The last thread that leaves the gate also free's it.
-        gates.erase(it);
-      }
+    // Free any pending events.
+    while (Event* event = process->events.pop()) {
+      delete event;
+    }
 
-      CHECK(process->refs == 0);
-      process->state = ProcessBase::FINISHED;
+    // Lookup gate to wake up waiting threads.
+    map<ProcessBase*, Gate*>::iterator it = gates.find(process);
+    if (it != gates.end()) {
+      gate = it->second;
+      // N.B. The last thread that leaves the gate also free's it.
+      gates.erase(it);
     }
-    process->unlock();
+
+    CHECK(process->refs == 0);
 
     // Note that we don't remove the process from the clock during
     // cleanup, but rather the clock is reset for a process when it is
@@ -1919,7 +3137,7 @@ void ProcessManager::cleanup(ProcessBase* process)
     // that it can create exited events for linked processes. We
     // _must_ do this while synchronized on processes because
     // otherwise another process could attempt to link this process
-    // and SocketManger::link would see that the processes doesn't
+    // and ProcessManager::link would see that the processes doesn't
     // exist when it attempts to get a ProcessReference (since we
     // removed the process above) thus causing an exited event, which
     // could cause the process to get deleted (e.g., the garbage
@@ -1930,11 +3148,6 @@ void ProcessManager::cleanup(ProcessBase* process)
     socket_manager->exited(process);
   }
 
-  // Confirm process not in runq.
-  synchronized (runq) {
-    CHECK(find(runq.begin(), runq.end(), process) == runq.end());
-  }
-
   // ***************************************************************
   // At this point we can no longer dereference the process since it
   // might already be deallocated (e.g., by the garbage collector).
@@ -1960,7 +3173,13 @@ void ProcessManager::link(ProcessBase* process, const UPID& to)
     } else {
       // Since the pid isn't valid it's process must have already died
       // (or hasn't been spawned yet) so send a process exit message.
-      process->enqueue(new ExitedEvent(to));
+      // Note that the process might still be getting cleaned up
+      // (lookups don't wait for that), so we synchronize on processes
+      // to make sure the exited event doesn't fire until after
+      // ProcessManager::cleanup is done with the process.
+      synchronized (processes) {
+        process->enqueue(new ExitedEvent(to));
+      }
     }
   }
 }
@@ -2004,8 +3223,9 @@ bool ProcessManager::wait(const UPID& pid)
 
   // Try and approach the gate if necessary.
   synchronized (processes) {
-    if (processes.count(pid.id) > 0) {
-      process = processes[pid.id];
+    ConcurrentTable<ProcessBase*>::Reader reader(processes, pid.id);
+    if (reader.get() != NULL) {
+      process = *reader.get();
       CHECK(process->state != ProcessBase::FINISHED);
 
       // Check and see if a gate already exists.
@@ -2019,15 +3239,9 @@ bool ProcessManager::wait(const UPID& pid)
       // Check if it is runnable in order to donate this thread.
       if (process->state == ProcessBase::BOTTOM ||
           process->state == ProcessBase::READY) {
-        synchronized (runq) {
-          list<ProcessBase*>::iterator it =
-            find(runq.begin(), runq.end(), process);
-          if (it != runq.end()) {
-            runq.erase(it);
-          } else {
-            // Another thread has resumed the process ...
-            process = NULL;
-          }
+        if (!remove(process)) {
+          // Another thread has resumed the process ...
+          process = NULL;
         }
       } else {
         // Process is not runnable, so no need to donate ...
@@ -2061,44 +3275,108 @@ bool ProcessManager::wait(const UPID& pid)
 }
 
 
+vector<ProcessStatistics> ProcessManager::statistics()
+{
+  vector<ProcessStatistics> statistics;
+
+  // Hold the lock so that none of the processes get cleaned up while
+  // we look at them.
+  synchronized (processes) {
+    vector<ProcessBase*> values;
+    processes.values(&values);
+
+    foreach (ProcessBase* process, values) {
+      ProcessStatistics snapshot;
+      snapshot.id = process->pid.id;
+      snapshot.thread = process->thread;
+      snapshot.size = process->events.size();
+      snapshot.age = process->events.age();
+      snapshot.capacity = process->limit;
+      snapshot.dropped = process->overflows.dropped;
+      snapshot.rejected = process->overflows.rejected;
+      snapshot.blocked = process->overflows.blocked;
+      snapshot.statistics = process->statistics;
+      statistics.push_back(snapshot);
+    }
+  }
+
+  return statistics;
+}
+
+
 void ProcessManager::enqueue(ProcessBase* process)
 {
   CHECK(process != NULL);
+  CHECK(!runqs.empty());
+
+  // Put the process on the run queue of the thread it last ran
+  // on. If it has never run then put it on the current thread's run
+  // queue (if this is a processing thread), otherwise just pick the
+  // next run queue in round-robin order.
+  RunQueue* runq = NULL;
+
+  if (process->thread >= 0) {
+    runq = runqs[process->thread];
+  } else if (__runq__ != NULL) {
+    runq = __runq__;
+  } else {
+    runq = runqs[__sync_fetch_and_add(&next, 1) % runqs.size()];
+  }
+
+  runq->push(process);
 
-  // TODO(benh): Check and see if this process has it's own thread. If
-  // it does, push it on that threads runq, and wake up that thread if
-  // it's not running. Otherwise, check and see which thread this
-  // process was last running on, and put it on that threads runq.
+  __sync_synchronize();
 
-  synchronized (runq) {
-    CHECK(find(runq.begin(), runq.end(), process) == runq.end());
-    runq.push_back(process);
+  // Wake up the owning thread if it is idle, otherwise wake up some
+  // other idle thread (if any) so that it can steal the process.
+  if (runq->idle) {
+    runq->gate->open(false);
+  } else {
+    foreach (RunQueue* other, runqs) {
+      if (other->idle) {
+        other->gate->open(false);
+        break;
+      }
+    }
   }
-    
-  // Wake up the processing thread if necessary.
-  gate->open();
 }
 
 
 ProcessBase* ProcessManager::dequeue()
 {
-  // TODO(benh): Remove a process from this thread's runq. If there
-  // are no processes to run, and this is not a dedicated thread, then
-  // steal one from another threads runq.
-
   ProcessBase* process = NULL;
 
-  synchronized (runq) {
-    if (!runq.empty()) {
-      process = runq.front();
-      runq.pop_front();
-    }
+  RunQueue* runq = __runq__;
+
+  CHECK(runq != NULL) << "Attempting to dequeue from a non-processing thread";
+
+  // Try our own run queue first.
+  process = runq->pop();
+
+  // Nothing on our own run queue, try and steal from one of the other
+  // threads (starting with our "neighbor" so that all of the threads
+  // don't go after the same victim). We steal the process that has
+  // been waiting the longest to keep scheduling roughly FIFO.
+  for (size_t i = 1; process == NULL && i < runqs.size(); i++) {
+    process = runqs[(runq->index + i) % runqs.size()]->pop();
   }
 
   return process;
 }
 
 
+bool ProcessManager::remove(ProcessBase* process)
+{
+  foreach (RunQueue* runq, runqs) {
+    if (runq->remove(process)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
 namespace timers {
 
 timer create(double secs, const lambda::function<void(void)>& thunk)
@@ -2116,7 +3394,7 @@ timer create(double secs, const lambda::function<void(void)>& thunk)
   }
 
   timer timer;
-  timer.id = id++;
+  timer.id = __sync_fetch_and_add(&id, 1);
   timer.timeout = timeout;
   timer.pid = __process__ != NULL ? __process__->self() : UPID();
   timer.thunk = thunk;
@@ -2126,15 +3404,12 @@ timer create(double secs, const lambda::function<void(void)>& thunk)
 
   // Add the timer.
   synchronized (timeouts) {
-    if (timeouts->size() == 0 || timer.timeout < timeouts->begin()->first) {
+    timeouts->add(timer);
+    if (timer.timeout < next_timeout) {
       // Need to interrupt the loop to update/set timer repeat.
-      (*timeouts)[timer.timeout].push_back(timer);
+      next_timeout = timer.timeout;
       update_timer = true;
       ev_async_send(loop, &async_watcher);
-    } else {
-      // Timer repeat is adequate, just add the timeout.
-      CHECK(timeouts->size() >= 1);
-      (*timeouts)[timer.timeout].push_back(timer);
     }
   }
 
@@ -2145,15 +3420,9 @@ timer create(double secs, const lambda::function<void(void)>& thunk)
 void cancel(const timer& timer)
 {
   synchronized (timeouts) {
-    // Check if the timeout is still pending, and if so, erase
-    // it. In addition, erase an empty list if we just removed the
-    // last timeout.
-    if (timeouts->count(timer.timeout) > 0) {
-      (*timeouts)[timer.timeout].remove(timer);
-      if ((*timeouts)[timer.timeout].empty()) {
-        timeouts->erase(timer.timeout);
-      }
-    }
+    // Remove the timer if it is still pending (this is a no-op if
+    // the timer has already expired).
+    timeouts->cancel(timer);
   }
 }
 
@@ -2166,10 +3435,24 @@ ProcessBase::ProcessBase(const std::string& _id)
 
   state = ProcessBase::BOTTOM;
 
-  pthread_mutex_init(&m, NULL);
-
   refs = 0;
 
+  thread = -1;
+
+  limit = 0;
+  policy = BLOCK;
+  overflows.dropped = 0;
+  overflows.rejected = 0;
+  overflows.blocked = 0;
+
+  pthread_mutex_init(&eviction, NULL);
+
+  pthread_mutex_init(&drain.mutex, NULL);
+  pthread_cond_init(&drain.cond, NULL);
+  drain.waiters = 0;
+
+  memset(&statistics, 0, sizeof(statistics));
+
   // Generate string representation of unique id for process.
   if (_id != "") {
     pid.id = _id;
@@ -2195,7 +3478,19 @@ ProcessBase::ProcessBase(const std::string& _id)
 }
 
 
-ProcessBase::~ProcessBase() {}
+ProcessBase::~ProcessBase()
+{
+  // Free any events that got enqueued after the process was cleaned
+  // up (see ProcessManager::cleanup).
+  while (Event* event = events.pop()) {
+    delete event;
+  }
+
+  pthread_cond_destroy(&drain.cond);
+  pthread_mutex_destroy(&drain.mutex);
+
+  pthread_mutex_destroy(&eviction);
+}
 
 
 void ProcessBase::enqueue(Event* event, bool inject)
@@ -2209,65 +3504,176 @@ void ProcessBase::enqueue(Event* event, bool inject)
   // the messages in non-deterministic orderings (i.e., there are two
   // "atomic" blocks, the filter code here and the enqueue code
   // below).
-  synchronized (filterer) {
-    if (filterer != NULL) {
-      bool filter = false;
-      struct FilterVisitor : EventVisitor
-      {
-        FilterVisitor(bool* _filter) : filter(_filter) {}
-
-        virtual void visit(const MessageEvent& event)
+  //
+  // Only acquire the filterer lock if a filter is actually installed
+  // (and then check again while holding the lock since the filter
+  // might have been removed in the mean time).
+  if (filterer != NULL) {
+    synchronized (filterer) {
+      if (filterer != NULL) {
+        bool filter = false;
+        struct FilterVisitor : EventVisitor
         {
-          *filter = filterer->filter(event);
-        }
+          FilterVisitor(bool* _filter) : filter(_filter) {}
 
-        virtual void visit(const DispatchEvent& event)
-        {
-          *filter = filterer->filter(event);
-        }
+          virtual void visit(const MessageEvent& event)
+          {
+            *filter = filterer->filter(event);
+          }
 
-        virtual void visit(const HttpEvent& event)
-        {
-          *filter = filterer->filter(event);
-        }
+          virtual void visit(const DispatchEvent& event)
+          {
+            *filter = filterer->filter(event);
+          }
 
-        virtual void visit(const ExitedEvent& event)
-        {
-          *filter = filterer->filter(event);
-        }
+          virtual void visit(const HttpEvent& event)
+          {
+            *filter = filterer->filter(event);
+          }
 
-        bool* filter;
-      } visitor(&filter);
+          virtual void visit(const ExitedEvent& event)
+          {
+            *filter = filterer->filter(event);
+          }
 
-      event->visit(&visitor);
+          bool* filter;
+        } visitor(&filter);
 
-      if (filter) {
-        delete event;
-        return;
+        event->visit(&visitor);
+
+        if (filter) {
+          delete event;
+          return;
+        }
       }
     }
   }
 
-  lock();
+  if (state == FINISHED) {
+    delete event;
+    return;
+  }
+
+  // Injected events skip the line anyway (and are needed for things
+  // like terminating), so only regular events count against the
+  // capacity of the mailbox.
+  if (limit > 0 && !inject && policy == DROP_OLDEST) {
+    // Make room and push while holding the lock so that droppable
+    // messages never make the mailbox grow beyond its capacity.
+    pthread_mutex_lock(&eviction);
+
+    const bool queue = events.size() < limit || overflow(event);
+
+    if (queue) {
+      events.push(event);
+    }
+
+    pthread_mutex_unlock(&eviction);
+
+    if (!queue) {
+      return;
+    }
+  } else {
+    if (limit > 0 && !inject && events.size() >= limit && !overflow(event)) {
+      return;
+    }
+
+    if (!inject) {
+      events.push(event);
+    } else {
+      events.inject(event);
+    }
+  }
+
+  // Pushing the event was a full memory barrier, so either we see
+  // that the process has BLOCKED or the thread running the process
+  // will see the event (see ProcessManager::resume).
+  if (state == BLOCKED &&
+      __sync_bool_compare_and_swap(&state, BLOCKED, READY)) {
+    process_manager->enqueue(this);
+  }
+}
+
+
+// Matches the messages with one of the given names.
+struct Droppable
+{
+  explicit Droppable(const set<string>& _names) : names(_names) {}
+
+  bool operator () (Event* event) const
   {
-    if (state != FINISHED) {
-      if (!inject) {
-        events.push_back(event);
-      } else {
-        events.push_front(event);
+    return event->is<MessageEvent>() &&
+      names.count(event->as<MessageEvent>().message->name) > 0;
+  }
+
+  const set<string>& names;
+};
+
+
+bool ProcessBase::overflow(Event* event)
+{
+  switch (policy) {
+    case DROP_OLDEST: {
+      // Invoked while holding 'eviction' (see ProcessBase::enqueue).
+      const Droppable matches(droppable);
+
+      if (Event* oldest = events.remove(matches)) {
+        VLOG(2) << "Dropping message '"
+                << oldest->as<MessageEvent>().message->name
+                << "' since the mailbox of " << pid << " is full";
+        __sync_fetch_and_add(&overflows.dropped, 1);
+        delete oldest;
+        return true;
+      } else if (matches(event)) {
+        VLOG(2) << "Dropping message '"
+                << event->as<MessageEvent>().message->name
+                << "' since the mailbox of " << pid << " is full";
+        __sync_fetch_and_add(&overflows.dropped, 1);
+        delete event;
+        return false;
       }
+      return true;
+    }
 
-      if (state == BLOCKED) {
-        state = READY;
-        process_manager->enqueue(this);
+    case REJECT:
+      if (event->is<MessageEvent>()) {
+        const Message* message = event->as<MessageEvent>().message;
+
+        // Never reject an OVERLOADED message since two overloaded
+        // processes could otherwise keep rejecting each other's.
+        if (message->name != OVERLOADED) {
+          VLOG(1) << "Rejecting message '" << message->name << "' from "
+                  << message->from << " since the mailbox of " << pid
+                  << " is full";
+          __sync_fetch_and_add(&overflows.rejected, 1);
+          send(message->from, OVERLOADED, message->name.data(),
+               message->name.size());
+          delete event;
+          return false;
+        }
       }
+      return true;
 
-      CHECK(state == BOTTOM ||
-            state == READY ||
-            state == RUNNING);
-    }
+    case BLOCK:
+      if (__process__ == NULL && __loop__ == NULL) {
+        __sync_fetch_and_add(&overflows.blocked, 1);
+        pthread_mutex_lock(&drain.mutex);
+        {
+          // Incrementing is a full memory barrier, so either we see
+          // the room that the process made or the process sees us
+          // waiting (see ProcessManager::resume).
+          __sync_fetch_and_add(&drain.waiters, 1);
+          while (events.size() >= limit && state != FINISHED) {
+            pthread_cond_wait(&drain.cond, &drain.mutex);
+          }
+          __sync_fetch_and_sub(&drain.waiters, 1);
+        }
+        pthread_mutex_unlock(&drain.mutex);
+      }
+      return true;
   }
-  unlock();
+
+  return true;
 }
 
 
@@ -2276,7 +3682,7 @@ void ProcessBase::inject(const UPID& from, const string& name, const char* data,
   if (!from)
     return;
 
-  Message* message = encode(from, pid, name, string(data, length));
+  Message* message = encode(from, pid, name, Buffer(data, length));
 
   enqueue(new MessageEvent(message), true);
 }
@@ -2289,7 +3695,18 @@ void ProcessBase::send(const UPID& to, const string& name, const char* data, siz
   }
 
   // Encode and transport outgoing message.
-  transport(encode(pid, to, name, string(data, length)), this);
+  transport(encode(pid, to, name, Buffer(data, length)), this);
+}
+
+
+void ProcessBase::send(const UPID& to, const string& name, const Buffer& body)
+{
+  if (!to) {
+    return;
+  }
+
+  // Encode and transport outgoing message (without copying the body).
+  transport(encode(pid, to, name, body), this);
 }
 
 
@@ -2311,7 +3728,7 @@ void ProcessBase::visit(const MessageEvent& event)
 
 void ProcessBase::visit(const DispatchEvent& event)
 {
-  (*event.function)(this);
+  event.apply(this);
 }
 
 
@@ -2477,6 +3894,7 @@ void filter(Filter *filter)
 
   synchronized (filterer) {
     filterer = filter;
+    __sync_synchronize();
   }
 }
 
@@ -2490,7 +3908,20 @@ void post(const UPID& to, const string& name, const char* data, size_t length)
   }
 
   // Encode and transport outgoing message.
-  transport(encode(UPID(), to, name, string(data, length)));
+  transport(encode(UPID(), to, name, Buffer(data, length)));
+}
+
+
+void post(const UPID& to, const string& name, const Buffer& body)
+{
+  process::initialize();
+
+  if (!to) {
+    return;
+  }
+
+  // Encode and transport outgoing message (without copying the body).
+  transport(encode(UPID(), to, name, body));
 }
 
 
@@ -2500,7 +3931,15 @@ void dispatch(const UPID& pid, lambda::function<void(ProcessBase*)>* f)
 {
   process::initialize();
 
-  process_manager->deliver(pid, f, __process__);
+  process_manager->deliver(pid, new DispatchEvent(f), __process__);
+}
+
+
+void deliver(const UPID& pid, DispatchEvent* event)
+{
+  process::initialize();
+
+  process_manager->deliver(pid, event, __process__);
 }
 
 } // namespace internal {
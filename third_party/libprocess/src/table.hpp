@@ -0,0 +1,207 @@
+#ifndef __TABLE_HPP__
+#define __TABLE_HPP__
+
+#include <stdlib.h> // For NULL.
+
+#include <string>
+#include <vector>
+#include <tr1/functional>
+
+namespace process {
+
+// A hash table from strings to values that can be read concurrently
+// without taking any locks (e.g., for looking up processes by their
+// id on every local delivery). Writers (i.e., 'insert' and 'erase')
+// are not synchronized with each other, callers are expected to do
+// their own locking for those.
+//
+// Each bucket counts the readers that are currently looking at it
+// (see 'Reader'), split into two generations ("epochs"). Erasing a
+// key unlinks its entry, starts a new epoch for the bucket and then
+// waits until all of the readers of the previous epoch are gone
+// before deleting the entry. Any reader that comes afterwards can't
+// find the entry anymore, so once 'erase' returns nobody is using
+// the value that was erased (which is what lets the process manager
+// wait for all references to a process after erasing it).
+template <typename T>
+class ConcurrentTable
+{
+  struct Bucket;
+
+public:
+  explicit ConcurrentTable(size_t _size = 4096)
+    : size(_size), buckets(new Bucket[_size])
+  {
+    for (size_t i = 0; i < size; i++) {
+      buckets[i].head = NULL;
+      buckets[i].epoch = 0;
+      buckets[i].readers[0] = 0;
+      buckets[i].readers[1] = 0;
+    }
+  }
+
+  ~ConcurrentTable()
+  {
+    for (size_t i = 0; i < size; i++) {
+      while (buckets[i].head != NULL) {
+        Entry* entry = buckets[i].head;
+        buckets[i].head = entry->next;
+        delete entry;
+      }
+    }
+    delete[] buckets;
+  }
+
+  // Looks up a key, the value (if found) can be used for as long as
+  // the reader exists, even if the key gets erased concurrently.
+  class Reader
+  {
+  public:
+    Reader(const ConcurrentTable& table, const std::string& key)
+      : bucket(table.bucket(key)), value(NULL)
+    {
+      // Join the current epoch of the bucket, making sure that a
+      // writer didn't start a new epoch while we were joining (in
+      // which case it might not have seen us).
+      while (true) {
+        epoch = bucket->epoch;
+        __sync_fetch_and_add(&bucket->readers[epoch & 1], 1);
+        if (bucket->epoch == epoch) {
+          break;
+        }
+        __sync_fetch_and_sub(&bucket->readers[epoch & 1], 1);
+      }
+
+      for (Entry* entry = bucket->head; entry != NULL; entry = entry->next) {
+        if (entry->key == key) {
+          value = &entry->value;
+          break;
+        }
+      }
+    }
+
+    ~Reader()
+    {
+      __sync_fetch_and_sub(&bucket->readers[epoch & 1], 1);
+    }
+
+    // Returns the value or NULL if the key was not found.
+    const T* get() const { return value; }
+
+  private:
+    Reader(const Reader&);
+    Reader& operator = (const Reader&);
+
+    Bucket* bucket;
+    unsigned int epoch;
+    const T* value;
+  };
+
+  // Returns false if the key is already in the table.
+  bool insert(const std::string& key, const T& value)
+  {
+    Bucket* bucket = this->bucket(key);
+
+    for (Entry* entry = bucket->head; entry != NULL; entry = entry->next) {
+      if (entry->key == key) {
+        return false;
+      }
+    }
+
+    Entry* entry = new Entry(key, value);
+    entry->next = bucket->head;
+
+    // Make sure the entry is complete before readers can see it.
+    __sync_synchronize();
+
+    bucket->head = entry;
+    return true;
+  }
+
+  // Returns false if the key is not in the table. Blocks until every
+  // reader that might have seen the entry is gone.
+  bool erase(const std::string& key)
+  {
+    Bucket* bucket = this->bucket(key);
+
+    Entry* volatile* next = &bucket->head;
+    while (*next != NULL && (*next)->key != key) {
+      next = &(*next)->next;
+    }
+
+    Entry* entry = *next;
+
+    if (entry == NULL) {
+      return false;
+    }
+
+    *next = entry->next;
+
+    // Start a new epoch and wait for the readers of the last one.
+    const unsigned int epoch = bucket->epoch;
+    bucket->epoch = epoch + 1;
+    __sync_synchronize();
+
+    while (bucket->readers[epoch & 1] != 0) {
+      asm ("pause");
+      __sync_synchronize();
+    }
+
+    delete entry;
+    return true;
+  }
+
+  // Returns whether or not the key is in the table (only meant to be
+  // called by writers).
+  bool contains(const std::string& key) const
+  {
+    return Reader(*this, key).get() != NULL;
+  }
+
+  // Appends all of the values to 'values' (only meant to be called
+  // by writers).
+  void values(std::vector<T>* values) const
+  {
+    for (size_t i = 0; i < size; i++) {
+      for (Entry* entry = buckets[i].head; entry != NULL; entry = entry->next) {
+        values->push_back(entry->value);
+      }
+    }
+  }
+
+private:
+  struct Entry
+  {
+    Entry(const std::string& _key, const T& _value)
+      : key(_key), value(_value), next(NULL) {}
+
+    const std::string key;
+    const T value;
+    Entry* volatile next;
+  };
+
+  // Padded to a cache line so that readers of different buckets
+  // don't contend with each other.
+  struct Bucket
+  {
+    Entry* volatile head;
+    volatile unsigned int epoch;
+    volatile int readers[2];
+    char padding[64 - sizeof(Entry*) - 3 * sizeof(int)];
+  };
+
+  ConcurrentTable(const ConcurrentTable&);
+  ConcurrentTable& operator = (const ConcurrentTable&);
+
+  Bucket* bucket(const std::string& key) const
+  {
+    return &buckets[std::tr1::hash<std::string>()(key) % size];
+  }
+
+  const size_t size;
+  Bucket* buckets;
+};
+
+} // namespace process {
+
+#endif // __TABLE_HPP__
@@ -0,0 +1,323 @@
+#ifndef __WHEEL_HPP__
+#define __WHEEL_HPP__
+
+#include <float.h>
+#include <stdint.h>
+#include <stdlib.h> // For NULL.
+
+#include <list>
+#include <tr1/unordered_map>
+
+#include <process/timer.hpp>
+
+namespace process {
+
+// A hierarchical (hashed) timer wheel. Time is divided into 'ticks'
+// of 'resolution' seconds and each level of the wheel has 'SLOTS'
+// slots, where a slot at level N spans SLOTS^N ticks. A timer is
+// placed at the lowest level that can hold it (based on how many
+// ticks in the future it expires) and gets moved ("cascaded") to the
+// lower levels as time advances, so adding and canceling a timer are
+// O(1) and expiring timers is proportional to the number of timers
+// that expired (plus the number of ticks that actually need to be
+// looked at, empty stretches of the wheel get skipped).
+//
+// Timers that expire within the current tick are kept in the slot of
+// the current tick until the time passes their timeout, so a timer
+// never expires early (or late, when 'expire' is called at the
+// timeout of the timer). The wheel is not synchronized, callers are
+// expected to do their own locking.
+class TimerWheel
+{
+public:
+  explicit TimerWheel(double _resolution = 0.001)
+    : resolution(_resolution), current(0), count(0)
+  {
+    for (int level = 0; level < LEVELS; level++) {
+      counts[level] = 0;
+      for (int slot = 0; slot < SLOTS; slot++) {
+        slots[level][slot] = NULL;
+      }
+    }
+  }
+
+  ~TimerWheel()
+  {
+    for (int level = 0; level < LEVELS; level++) {
+      for (int slot = 0; slot < SLOTS; slot++) {
+        while (slots[level][slot] != NULL) {
+          Entry* entry = slots[level][slot];
+          unlink(entry);
+          delete entry;
+        }
+      }
+    }
+  }
+
+  // Adds the timer to the wheel.
+  void add(const timer& timer)
+  {
+    Entry* entry = new Entry();
+    entry->t = timer;
+    entry->tick = ticks(timer.timeout);
+
+    // Move an empty wheel up to the timer so that we don't have to
+    // walk through all the ticks since the wheel was last used (any
+    // timers that get added with an earlier timeout simply end up in
+    // the slot of the current tick).
+    if (count == 0 && entry->tick > current) {
+      current = entry->tick;
+    }
+
+    insert(entry);
+    entries[timer.id] = entry;
+    count++;
+  }
+
+  // Removes the timer from the wheel, returns false if the timer is
+  // not in the wheel (e.g., it has already expired).
+  bool cancel(const timer& timer)
+  {
+    std::tr1::unordered_map<long, Entry*>::iterator iterator =
+      entries.find(timer.id);
+
+    if (iterator == entries.end()) {
+      return false;
+    }
+
+    Entry* entry = iterator->second;
+    entries.erase(iterator);
+    unlink(entry);
+    delete entry;
+    count--;
+    return true;
+  }
+
+  // Removes all of the timers that have a timeout less than or equal
+  // to 'now' and appends them to 'expired', ordered by timeout (and
+  // then by the order in which they were created).
+  void expire(double now, std::list<timer>* expired)
+  {
+    std::list<timer> timers;
+
+    // Collect what's ready from the current tick first since timers
+    // might have been left there by the last call to 'expire'.
+    collect(current, now, &timers);
+
+    const uint64_t target = ticks(now);
+
+    while (current < target) {
+      if (count == 0) {
+        current = target;
+        break;
+      }
+
+      // If the lower levels are empty nothing can happen until the
+      // next slot of the lowest non-empty level gets cascaded, so
+      // jump straight to the tick before that.
+      int level = 0;
+      while (level < LEVELS - 1 && counts[level] == 0) {
+        level++;
+      }
+
+      if (level > 0) {
+        const int shift = level * BITS;
+        const uint64_t boundary = ((current >> shift) + 1) << shift;
+        if (boundary > target) {
+          current = target;
+          break;
+        }
+        current = boundary - 1;
+      }
+
+      current++;
+
+      // Cascade the timers of the next slot of each level whose
+      // preceding level just wrapped around.
+      for (int level = 1; level < LEVELS; level++) {
+        const int shift = level * BITS;
+        if ((current & ((1ULL << shift) - 1)) != 0) {
+          break;
+        }
+        cascade(level, (current >> shift) & MASK);
+      }
+
+      collect(current, now, &timers);
+    }
+
+    timers.sort(before);
+    expired->splice(expired->end(), timers);
+  }
+
+  // Returns the earliest timeout of all the timers in the wheel, or
+  // DBL_MAX if there are no timers.
+  double next() const
+  {
+    double timeout = DBL_MAX;
+
+    // The first non-empty slot of each level holds the earliest timer
+    // of that level, but a timer that was added at a higher level a
+    // while ago can be due before the timers at the lower levels, so
+    // every level needs to be looked at. Note that at the higher
+    // levels the slot of the current tick has already been cascaded,
+    // so anything in it belongs to the next round and gets looked at
+    // last.
+    for (int level = 0; level < LEVELS; level++) {
+      if (counts[level] == 0) {
+        continue;
+      }
+
+      const int shift = level * BITS;
+      const uint64_t first = level == 0 ? 0 : 1;
+
+      for (uint64_t index = first; index < first + SLOTS; index++) {
+        Entry* entry = slots[level][((current >> shift) + index) & MASK];
+        if (entry != NULL) {
+          for (; entry != NULL; entry = entry->next) {
+            if (entry->t.timeout < timeout) {
+              timeout = entry->t.timeout;
+            }
+          }
+          break;
+        }
+      }
+    }
+
+    return timeout;
+  }
+
+  size_t size() const { return count; }
+
+  bool empty() const { return count == 0; }
+
+private:
+  enum {
+    BITS = 8,
+    SLOTS = 1 << BITS,
+    MASK = SLOTS - 1,
+    LEVELS = 4,
+  };
+
+  struct Entry
+  {
+    timer t;
+    uint64_t tick;
+    int level;
+    Entry* next;
+    Entry** prev; // Points to the 'next' pointer pointing to us.
+  };
+
+  TimerWheel(const TimerWheel&);
+  TimerWheel& operator = (const TimerWheel&);
+
+  static bool before(const timer& left, const timer& right)
+  {
+    if (left.timeout == right.timeout) {
+      return left.id < right.id;
+    }
+    return left.timeout < right.timeout;
+  }
+
+  uint64_t ticks(double timeout) const
+  {
+    return timeout > 0 ? (uint64_t) (timeout / resolution) : 0;
+  }
+
+  // Puts the entry into the slot of the lowest level that can hold
+  // it. Entries that should have expired already go into the slot of
+  // the current tick and entries that are further out than the wheel
+  // can hold go into the last slot (in the current round) of the
+  // highest level (and get placed again when that slot gets
+  // cascaded).
+  void insert(Entry* entry)
+  {
+    uint64_t tick = entry->tick;
+
+    if (tick < current) {
+      tick = current;
+    }
+
+    const int top = (LEVELS - 1) * BITS;
+
+    if (tick - current >= (1ULL << (LEVELS * BITS))) {
+      tick = ((current >> top) + MASK) << top;
+    }
+
+    const uint64_t delta = tick - current;
+
+    int level = 0;
+    while (level < LEVELS - 1 && delta >= (1ULL << ((level + 1) * BITS))) {
+      level++;
+    }
+
+    link(entry, level, (tick >> (level * BITS)) & MASK);
+  }
+
+  void link(Entry* entry, int level, uint64_t slot)
+  {
+    Entry** head = &slots[level][slot];
+    entry->level = level;
+    entry->next = *head;
+    entry->prev = head;
+    if (*head != NULL) {
+      (*head)->prev = &entry->next;
+    }
+    *head = entry;
+    counts[level]++;
+  }
+
+  void unlink(Entry* entry)
+  {
+    *entry->prev = entry->next;
+    if (entry->next != NULL) {
+      entry->next->prev = entry->prev;
+    }
+    counts[entry->level]--;
+  }
+
+  void cascade(int level, uint64_t slot)
+  {
+    Entry* entry = slots[level][slot];
+    slots[level][slot] = NULL;
+    while (entry != NULL) {
+      Entry* next = entry->next;
+      counts[level]--;
+      insert(entry);
+      entry = next;
+    }
+  }
+
+  // Removes the entries in the slot of 'tick' that have a timeout
+  // less than or equal to 'now'.
+  void collect(uint64_t tick, double now, std::list<timer>* timers)
+  {
+    Entry* entry = slots[0][tick & MASK];
+    while (entry != NULL) {
+      Entry* next = entry->next;
+      if (entry->t.timeout <= now) {
+        unlink(entry);
+        entries.erase(entry->t.id);
+        timers->push_back(entry->t);
+        delete entry;
+        count--;
+      }
+      entry = next;
+    }
+  }
+
+  const double resolution;
+
+  // The tick up to which (inclusive) the wheel has been expired.
+  uint64_t current;
+
+  Entry* slots[LEVELS][SLOTS];
+  size_t counts[LEVELS];
+  size_t count;
+
+  // Entries indexed by timer id so that they can be canceled.
+  std::tr1::unordered_map<long, Entry*> entries;
+};
+
+} // namespace process {
+
+#endif // __WHEEL_HPP__